@@ -0,0 +1,554 @@
+// Benchmarks the CPU crop and NMS kernels per shape bucket and places them on
+// a roofline measured on the local machine.
+//
+//   kernel_benchmark_3d [--threads=n] [--min_time=seconds]
+//       [--stream_mb=megabytes] [--csv]
+//
+// For every kernel and bucket it reports the time per call, the hardware
+// counters of the run (cycles, instructions, LLC and dTLB load misses, or
+// n/a when perf_event_open is not permitted), the achieved GFLOP/s and GB/s,
+// and how close they come to the roofline of the machine. Flops and bytes are
+// analytic: the arithmetic of the kernel and its compulsory memory traffic,
+// i.e. every image voxel a box samples read once and every output written
+// once. The roofline is made of a STREAM triad bandwidth and a multiply-add
+// throughput, both measured with the same number of threads.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "benchmark/cc/perf_counters.h"
+#include "crop_and_resize_3d/cc/kernels/crop_and_resize_3d.h"
+#include "non_max_suppression_3d/cc/kernels/non_max_suppression_3d_cpu.h"
+
+namespace benchmark {
+namespace {
+
+using tensorflow::functor::CropAndResize3DBox;
+using tensorflow::functor::CropAxisSample;
+using tensorflow::functor::ComputeCropAxisSamples;
+using tensorflow::functor::NonMaxSuppression3DGreedy;
+using tensorflow::functor::NonMaxSuppression3DThresholdSweep;
+
+// Flops of one lerp, a + (b - a) * t, and of one IOU3D call (12 min/max for
+// the corners, 10 for the volumes, 14 for the intersection, 3 for the union
+// and the division).
+const double kFlopsPerLerp = 3;
+const double kFlopsPerIOU = 39;
+
+struct Options {
+  int threads = 1;
+  double min_time = 0.2;
+  int stream_mb = 64;
+  bool csv = false;
+};
+
+struct Roofline {
+  double bytes_per_second;
+  double flops_per_second;
+};
+
+// What one call of a kernel does, and how to run it.
+struct Workload {
+  std::string kernel;
+  std::string bucket;
+  double flops;
+  double bytes;
+  // Runs the kernel 'reps' times on 'threads' threads.
+  std::function<void(int reps, int threads)> run;
+};
+
+struct Measurement {
+  double seconds_per_call;
+  bool counters[PerfCounters::kNumCounters];
+  double counters_per_call[PerfCounters::kNumCounters];
+};
+
+double Now() {
+  return std::chrono::duration<double>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// Runs fn(thread, num_threads) on 'threads' threads and waits for them.
+template <typename Fn>
+void RunOnThreads(int threads, const Fn& fn) {
+  std::vector<std::thread> workers;
+  for (int t = 1; t < threads; ++t) {
+    workers.emplace_back([&fn, t, threads]() { fn(t, threads); });
+  }
+  fn(0, threads);
+  for (std::thread& worker : workers) {
+    worker.join();
+  }
+}
+
+// STREAM triad a = b + s * c, counting 12 bytes per element as STREAM does.
+double MeasureStreamBandwidth(int threads, int stream_mb) {
+  const int64_t n = static_cast<int64_t>(stream_mb) * (1 << 20) / sizeof(float);
+  std::vector<float> a(n), b(n, 1.0f), c(n, 2.0f);
+  double best = 0;
+  for (int trial = 0; trial < 5; ++trial) {
+    const double start = Now();
+    RunOnThreads(threads, [&](int t, int num_threads) {
+      const int64_t begin = n * t / num_threads;
+      const int64_t end = n * (t + 1) / num_threads;
+      float* pa = a.data();
+      const float* pb = b.data();
+      const float* pc = c.data();
+      for (int64_t i = begin; i < end; ++i) {
+        pa[i] = pb[i] + 3.0f * pc[i];
+      }
+    });
+    best = std::max(best, 3.0 * sizeof(float) * n / (Now() - start));
+  }
+  volatile float sink = a[n / 2];
+  (void)sink;
+  return best;
+}
+
+// Multiply-add chains of the peak throughput probe. The rest of the
+// benchmark is built for the baseline ISA of the compiler (SSE2 on x86-64),
+// which has no fused multiply-add, so x86 hosts also get fused chains built
+// for AVX2 and AVX-512 and pick the widest they run at run time. Otherwise
+// the compute roof would be that of the build, not of the machine.
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BENCHMARK_X86_DISPATCH 1
+#endif
+
+// Twelve vector registers of chains per ISA, enough to cover the latency of
+// two multiply-add units.
+const int kMaxChains = 192;
+
+template <int kChains, bool kFused>
+inline __attribute__((always_inline)) void RunChains(float* acc,
+                                                     int64_t iterations) {
+  // Fully unrolled, the chains live in registers instead of making a round
+  // trip through memory at every iteration.
+  float chains[kChains];
+  std::copy(acc, acc + kChains, chains);
+  for (int64_t i = 0; i < iterations; ++i) {
+#pragma GCC unroll 192
+    for (int k = 0; k < kChains; ++k) {
+      chains[k] = kFused ? std::fma(chains[k], 0.999999f, 1e-6f)
+                         : chains[k] * 0.999999f + 1e-6f;
+    }
+  }
+  std::copy(chains, chains + kChains, acc);
+}
+
+void RunBaselineChains(float* acc, int64_t iterations) {
+  RunChains<48, false>(acc, iterations);
+}
+
+#ifdef BENCHMARK_X86_DISPATCH
+__attribute__((target("avx2,fma"))) void RunAvx2Chains(float* acc,
+                                                       int64_t iterations) {
+  RunChains<96, true>(acc, iterations);
+}
+
+__attribute__((target("avx512f,fma"))) void RunAvx512Chains(
+    float* acc, int64_t iterations) {
+  RunChains<kMaxChains, true>(acc, iterations);
+}
+#endif
+
+// Chains of one ISA: how many there are and how to run them.
+struct PeakChains {
+  const char* isa;
+  int chains;
+  void (*run)(float* acc, int64_t iterations);
+};
+
+// Returns the widest chains the host runs.
+PeakChains SelectPeakChains() {
+#ifdef BENCHMARK_X86_DISPATCH
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("fma")) {
+    if (__builtin_cpu_supports("avx512f")) {
+      return {"avx512 fma", kMaxChains, RunAvx512Chains};
+    }
+    if (__builtin_cpu_supports("avx2")) {
+      return {"avx2 fma", 96, RunAvx2Chains};
+    }
+  }
+#endif
+  return {"baseline isa, no fma", 48, RunBaselineChains};
+}
+
+// Independent multiply-add chains, wide enough to keep every vector unit of
+// the widest ISA of the host busy. Returns that ISA in 'isa'.
+double MeasurePeakFlops(int threads, const char** isa) {
+  const PeakChains peak_chains = SelectPeakChains();
+  *isa = peak_chains.isa;
+  const int64_t kIterations = 1 << 22;
+  double best = 0;
+  for (int trial = 0; trial < 3; ++trial) {
+    std::vector<float> sums(threads);
+    const double start = Now();
+    RunOnThreads(threads, [&](int t, int /*num_threads*/) {
+      float acc[kMaxChains];
+      for (int k = 0; k < peak_chains.chains; ++k) {
+        acc[k] = k + t;
+      }
+      peak_chains.run(acc, kIterations);
+      float sum = 0;
+      for (int k = 0; k < peak_chains.chains; ++k) {
+        sum += acc[k];
+      }
+      sums[t] = sum;
+    });
+    best = std::max(best, 2.0 * peak_chains.chains * kIterations * threads /
+                              (Now() - start));
+    volatile float sink = sums[0];
+    (void)sink;
+  }
+  return best;
+}
+
+Measurement Measure(const Workload& workload, const Options& options,
+                    PerfCounters* counters) {
+  // Warms the caches up, then picks a repetition count lasting min_time.
+  workload.run(1, options.threads);
+  int reps = 1;
+  for (;;) {
+    const double start = Now();
+    workload.run(reps, options.threads);
+    const double elapsed = Now() - start;
+    if (elapsed >= options.min_time / 4 || reps >= (1 << 20)) {
+      reps = std::max<int>(1, reps * options.min_time / std::max(elapsed, 1e-9));
+      break;
+    }
+    reps *= 4;
+  }
+
+  Measurement measurement;
+  counters->Start();
+  const double start = Now();
+  workload.run(reps, options.threads);
+  measurement.seconds_per_call = (Now() - start) / reps;
+  counters->Stop();
+  for (int i = 0; i < PerfCounters::kNumCounters; ++i) {
+    const PerfCounters::Counter counter = static_cast<PerfCounters::Counter>(i);
+    measurement.counters[i] = counters->available(counter);
+    measurement.counters_per_call[i] = counters->value(counter) / reps;
+  }
+  return measurement;
+}
+
+// Number of distinct voxels the samples of one axis read.
+int TouchedVoxels(const std::vector<CropAxisSample>& samples, bool trilinear) {
+  std::vector<int> voxels;
+  for (const CropAxisSample& sample : samples) {
+    if (!sample.valid) {
+      continue;
+    }
+    if (trilinear) {
+      voxels.push_back(sample.lower);
+      voxels.push_back(sample.upper);
+    } else {
+      voxels.push_back(sample.closest);
+    }
+  }
+  std::sort(voxels.begin(), voxels.end());
+  return std::unique(voxels.begin(), voxels.end()) - voxels.begin();
+}
+
+int CountValid(const std::vector<CropAxisSample>& samples) {
+  int valid = 0;
+  for (const CropAxisSample& sample : samples) {
+    valid += sample.valid;
+  }
+  return valid;
+}
+
+struct CropBucket {
+  const char* name;
+  int image_size;
+  int channels;
+  int crop_size;
+  int num_boxes;
+};
+
+// Boxes of 10% to 60% of the image along every axis, some of them partly
+// outside of it.
+std::vector<float> RandomBoxes(int num_boxes, std::mt19937* rng) {
+  std::uniform_real_distribution<float> extent(0.1f, 0.6f);
+  std::uniform_real_distribution<float> corner(-0.1f, 0.9f);
+  std::vector<float> boxes(6 * num_boxes);
+  for (int b = 0; b < num_boxes; ++b) {
+    for (int axis = 0; axis < 3; ++axis) {
+      boxes[6 * b + axis] = corner(*rng);
+      boxes[6 * b + axis + 3] = boxes[6 * b + axis] + extent(*rng);
+    }
+  }
+  return boxes;
+}
+
+Workload CropWorkload(const CropBucket& bucket, bool trilinear,
+                      std::mt19937* rng) {
+  const int size = bucket.image_size;
+  const int channels = bucket.channels;
+  const int crop = bucket.crop_size;
+  const int num_boxes = bucket.num_boxes;
+  auto image = std::make_shared<std::vector<float>>(
+      static_cast<int64_t>(size) * size * size * channels);
+  std::uniform_real_distribution<float> value(0.0f, 1.0f);
+  for (float& v : *image) {
+    v = value(*rng);
+  }
+  auto boxes = std::make_shared<std::vector<float>>(RandomBoxes(num_boxes, rng));
+  const int64_t crop_volume =
+      static_cast<int64_t>(crop) * crop * crop * channels;
+  auto crops = std::make_shared<std::vector<float>>(crop_volume * num_boxes);
+
+  Workload workload;
+  workload.kernel = trilinear ? "crop_trilinear" : "crop_nearest";
+  workload.bucket = bucket.name;
+  workload.flops = 0;
+  workload.bytes = 4.0 * crop_volume * num_boxes;
+  std::vector<CropAxisSample> samples[3];
+  for (int b = 0; b < num_boxes; ++b) {
+    double valid = 1;
+    double touched = 1;
+    for (int axis = 0; axis < 3; ++axis) {
+      samples[axis].resize(crop);
+      ComputeCropAxisSamples((*boxes)[6 * b + axis], (*boxes)[6 * b + axis + 3],
+                             size, crop, samples[axis].data());
+      valid *= CountValid(samples[axis]);
+      touched *= TouchedVoxels(samples[axis], trilinear);
+    }
+    if (trilinear) {
+      workload.flops += 7 * kFlopsPerLerp * valid * channels;
+    }
+    workload.bytes += 4.0 * touched * channels;
+  }
+  workload.run = [=](int reps, int threads) {
+    RunOnThreads(threads, [&](int t, int num_threads) {
+      for (int r = 0; r < reps; ++r) {
+        for (int b = t; b < num_boxes; b += num_threads) {
+          CropAndResize3DBox(image->data(), size, size, size, channels,
+                             boxes->data() + 6 * b, crop, crop, crop,
+                             trilinear, 0.0f, crops->data() + b * crop_volume);
+        }
+      }
+    });
+  };
+  return workload;
+}
+
+// A single NMS call, on one thread whatever 'threads' is.
+Workload NmsWorkload(int num_boxes, std::mt19937* rng) {
+  auto boxes = std::make_shared<std::vector<float>>(RandomBoxes(num_boxes, rng));
+  auto scores = std::make_shared<std::vector<float>>(num_boxes);
+  std::uniform_real_distribution<float> score(0.0f, 1.0f);
+  for (float& s : *scores) {
+    s = score(*rng);
+  }
+  std::vector<int> selected;
+  int64_t num_ious = 0;
+  NonMaxSuppression3DGreedy(boxes->data(), scores->data(), num_boxes, 0.5f,
+                            num_boxes, &selected, &num_ious);
+
+  Workload workload;
+  workload.kernel = "nms_greedy";
+  workload.bucket = "boxes_" + std::to_string(num_boxes);
+  workload.flops = kFlopsPerIOU * num_ious;
+  // Boxes and scores, plus the candidate list written and read back once.
+  workload.bytes = (7.0 + 2.0) * sizeof(float) * num_boxes;
+  workload.run = [=](int reps, int /*threads*/) {
+    std::vector<int> selected;
+    for (int r = 0; r < reps; ++r) {
+      NonMaxSuppression3DGreedy(boxes->data(), scores->data(), num_boxes, 0.5f,
+                                num_boxes, &selected);
+    }
+  };
+  return workload;
+}
+
+// A single NMS threshold sweep over 0.1, 0.2, ..., 0.9, on one thread.
+Workload NmsSweepWorkload(int num_boxes, std::mt19937* rng) {
+  auto boxes = std::make_shared<std::vector<float>>(RandomBoxes(num_boxes, rng));
+  auto scores = std::make_shared<std::vector<float>>(num_boxes);
+  std::uniform_real_distribution<float> score(0.0f, 1.0f);
+  for (float& s : *scores) {
+    s = score(*rng);
+  }
+  auto thresholds = std::make_shared<std::vector<float>>();
+  for (int t = 1; t <= 9; ++t) {
+    thresholds->push_back(0.1f * t);
+  }
+  const int num_thresholds = static_cast<int>(thresholds->size());
+  std::vector<std::vector<int>> selected;
+  int64_t num_ious = 0;
+  NonMaxSuppression3DThresholdSweep(boxes->data(), scores->data(), num_boxes,
+                                    thresholds->data(), num_thresholds,
+                                    num_boxes, &selected, &num_ious);
+
+  Workload workload;
+  workload.kernel = "nms_sweep_9";
+  workload.bucket = "boxes_" + std::to_string(num_boxes);
+  workload.flops = kFlopsPerIOU * num_ious;
+  // As nms_greedy, plus one selection list per threshold.
+  workload.bytes = (7.0 + 2.0 + num_thresholds) * sizeof(float) * num_boxes;
+  workload.run = [=](int reps, int /*threads*/) {
+    std::vector<std::vector<int>> selected;
+    for (int r = 0; r < reps; ++r) {
+      NonMaxSuppression3DThresholdSweep(boxes->data(), scores->data(),
+                                        num_boxes, thresholds->data(),
+                                        num_thresholds, num_boxes, &selected);
+    }
+  };
+  return workload;
+}
+
+std::string FormatCounter(const Measurement& m, PerfCounters::Counter counter) {
+  if (!m.counters[counter]) {
+    return "n/a";
+  }
+  char buffer[32];
+  std::snprintf(buffer, sizeof(buffer), "%.4g", m.counters_per_call[counter]);
+  return buffer;
+}
+
+void Report(const Workload& workload, const Measurement& m,
+            const Roofline& roofline, bool csv) {
+  const double flops_per_second = workload.flops / m.seconds_per_call;
+  const double bytes_per_second = workload.bytes / m.seconds_per_call;
+  const double intensity = workload.flops / workload.bytes;
+  const double ridge = roofline.flops_per_second / roofline.bytes_per_second;
+  // Without flops, the only roof is the bandwidth.
+  const bool memory_bound = intensity < ridge;
+  const double roof_fraction =
+      memory_bound ? bytes_per_second / roofline.bytes_per_second
+                   : flops_per_second / roofline.flops_per_second;
+  std::string ipc = "n/a";
+  if (m.counters[PerfCounters::kCycles] &&
+      m.counters[PerfCounters::kInstructions] &&
+      m.counters_per_call[PerfCounters::kCycles] > 0) {
+    char buffer[32];
+    std::snprintf(buffer, sizeof(buffer), "%.2f",
+                  m.counters_per_call[PerfCounters::kInstructions] /
+                      m.counters_per_call[PerfCounters::kCycles]);
+    ipc = buffer;
+  }
+  std::printf(csv ? "%s,%s,%.6g,%.4g,%.4g,%.4g,%s,%.3g,%s,%s,%s,%s,%s\n"
+                  : "%-15s %-14s %10.4g %8.3g %8.3g %8.3g %-7s %6.3g "
+                    "%10s %12s %5s %10s %10s\n",
+              workload.kernel.c_str(), workload.bucket.c_str(),
+              m.seconds_per_call * 1e3, flops_per_second * 1e-9,
+              bytes_per_second * 1e-9, intensity,
+              memory_bound ? "memory" : "compute", 100 * roof_fraction,
+              FormatCounter(m, PerfCounters::kCycles).c_str(),
+              FormatCounter(m, PerfCounters::kInstructions).c_str(),
+              ipc.c_str(), FormatCounter(m, PerfCounters::kLLCMisses).c_str(),
+              FormatCounter(m, PerfCounters::kDTLBMisses).c_str());
+}
+
+bool ParseOptions(int argc, char** argv, Options* options) {
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if (arg == "--csv") {
+      options->csv = true;
+    } else if (arg.compare(0, 10, "--threads=") == 0) {
+      options->threads = std::atoi(arg.c_str() + 10);
+    } else if (arg.compare(0, 11, "--min_time=") == 0) {
+      options->min_time = std::atof(arg.c_str() + 11);
+    } else if (arg.compare(0, 12, "--stream_mb=") == 0) {
+      options->stream_mb = std::atoi(arg.c_str() + 12);
+    } else {
+      return false;
+    }
+  }
+  return options->threads > 0 && options->min_time > 0 &&
+         options->stream_mb > 0;
+}
+
+int Run(const Options& options) {
+  PerfCounters counters;
+  if (!counters.any_available()) {
+    std::fprintf(stderr,
+                 "hardware counters are unavailable (no PMU, or "
+                 "kernel.perf_event_paranoid too high): reporting n/a\n");
+  }
+  Roofline roofline;
+  roofline.bytes_per_second =
+      MeasureStreamBandwidth(options.threads, options.stream_mb);
+  const char* peak_isa = "";
+  roofline.flops_per_second = MeasurePeakFlops(options.threads, &peak_isa);
+  std::printf(options.csv ? "# peak_gbs=%.4g,peak_gflops=%.4g,peak_isa=%s,"
+                            "ridge=%.3g,threads=%d\n"
+                          : "peak %.4g GB/s (STREAM triad), %.4g GFLOP/s "
+                            "(%s), ridge %.3g flop/B, %d thread(s)\n\n",
+              roofline.bytes_per_second * 1e-9,
+              roofline.flops_per_second * 1e-9, peak_isa,
+              roofline.flops_per_second / roofline.bytes_per_second,
+              options.threads);
+  std::printf(options.csv ? "%s,%s,%s,%s,%s,%s,%s,%s,%s,%s,%s,%s,%s\n"
+                          : "%-15s %-14s %10s %8s %8s %8s %-7s %6s %10s %12s "
+                            "%5s %10s %10s\n",
+              "kernel", "bucket", "ms/call", "GFLOP/s", "GB/s", "flop/B",
+              "bound", "%roof", "cycles", "instructions", "ipc", "llc_miss",
+              "dtlb_miss");
+
+  // Second-stage feature crops, then crops of full-resolution volumes.
+  const CropBucket kCropBuckets[] = {
+      {"fmap32_c64_7", 32, 64, 7, 256},
+      {"fmap32_c64_14", 32, 64, 14, 128},
+      {"vol128_c1_28", 128, 1, 28, 64},
+      {"vol128_c1_56", 128, 1, 56, 16},
+  };
+  std::mt19937 rng(0);
+  for (bool trilinear : {true, false}) {
+    for (const CropBucket& bucket : kCropBuckets) {
+      const Workload workload = CropWorkload(bucket, trilinear, &rng);
+      Report(workload, Measure(workload, options, &counters), roofline,
+             options.csv);
+    }
+  }
+  // NMS calls are sequential, so they are held against the roofline of a
+  // single thread.
+  Options single_thread = options;
+  single_thread.threads = 1;
+  Roofline single_thread_roofline = roofline;
+  if (options.threads > 1) {
+    single_thread_roofline.bytes_per_second =
+        MeasureStreamBandwidth(1, options.stream_mb);
+    single_thread_roofline.flops_per_second =
+        MeasurePeakFlops(1, &peak_isa);
+  }
+  for (int num_boxes : {256, 1024, 4096}) {
+    const Workload workload = NmsWorkload(num_boxes, &rng);
+    Report(workload, Measure(workload, single_thread, &counters),
+           single_thread_roofline, options.csv);
+  }
+  for (int num_boxes : {256, 1024, 4096}) {
+    const Workload workload = NmsSweepWorkload(num_boxes, &rng);
+    Report(workload, Measure(workload, single_thread, &counters),
+           single_thread_roofline, options.csv);
+  }
+  return 0;
+}
+
+}  // namespace
+}  // namespace benchmark
+
+int main(int argc, char** argv) {
+  benchmark::Options options;
+  if (!benchmark::ParseOptions(argc, argv, &options)) {
+    std::fprintf(stderr,
+                 "usage: kernel_benchmark_3d [--threads=n] "
+                 "[--min_time=seconds] [--stream_mb=megabytes] [--csv]\n");
+    return 2;
+  }
+  return benchmark::Run(options);
+}
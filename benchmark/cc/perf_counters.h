@@ -0,0 +1,150 @@
+#ifndef BENCHMARK_CC_PERF_COUNTERS_H_
+#define BENCHMARK_CC_PERF_COUNTERS_H_
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Hardware counters of the calling process (user space only, inherited by the
+// threads it starts afterwards), read through perf_event_open. Every counter
+// is opened on its own, so the others still work when the PMU, the kernel or
+// perf_event_paranoid refuses one of them.
+
+namespace benchmark {
+
+class PerfCounters {
+ public:
+  enum Counter { kCycles, kInstructions, kLLCMisses, kDTLBMisses, kNumCounters };
+
+  PerfCounters() {
+    for (int i = 0; i < kNumCounters; ++i) {
+      fds_[i] = Open(static_cast<Counter>(i));
+      values_[i] = 0;
+    }
+  }
+
+  ~PerfCounters() {
+#ifdef __linux__
+    for (int i = 0; i < kNumCounters; ++i) {
+      if (fds_[i] >= 0) {
+        close(fds_[i]);
+      }
+    }
+#endif
+  }
+
+  PerfCounters(const PerfCounters&) = delete;
+  PerfCounters& operator=(const PerfCounters&) = delete;
+
+  static const char* Name(Counter counter) {
+    static const char* kNames[kNumCounters] = {"cycles", "instructions",
+                                               "llc_misses", "dtlb_misses"};
+    return kNames[counter];
+  }
+
+  bool available(Counter counter) const { return fds_[counter] >= 0; }
+
+  bool any_available() const {
+    for (int i = 0; i < kNumCounters; ++i) {
+      if (fds_[i] >= 0) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Resets and starts the available counters.
+  void Start() {
+#ifdef __linux__
+    for (int i = 0; i < kNumCounters; ++i) {
+      if (fds_[i] >= 0) {
+        ioctl(fds_[i], PERF_EVENT_IOC_RESET, 0);
+        ioctl(fds_[i], PERF_EVENT_IOC_ENABLE, 0);
+      }
+    }
+#endif
+  }
+
+  // Stops the counters and latches their values since Start(), scaled up when
+  // the kernel multiplexed them.
+  void Stop() {
+#ifdef __linux__
+    for (int i = 0; i < kNumCounters; ++i) {
+      if (fds_[i] < 0) {
+        continue;
+      }
+      ioctl(fds_[i], PERF_EVENT_IOC_DISABLE, 0);
+      // value, time_enabled, time_running.
+      uint64_t data[3] = {0, 0, 0};
+      if (read(fds_[i], data, sizeof(data)) != sizeof(data)) {
+        values_[i] = 0;
+        continue;
+      }
+      values_[i] = (data[2] > 0 && data[2] < data[1])
+                       ? static_cast<double>(data[0]) * data[1] / data[2]
+                       : static_cast<double>(data[0]);
+    }
+#endif
+  }
+
+  // Value latched by the last Stop(), meaningful only if available().
+  double value(Counter counter) const { return values_[counter]; }
+
+ private:
+  static int Open(Counter counter) {
+#ifdef __linux__
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    switch (counter) {
+      case kCycles:
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_CPU_CYCLES;
+        break;
+      case kInstructions:
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+        break;
+      case kLLCMisses:
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = PERF_COUNT_HW_CACHE_LL |
+                      (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                      (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        break;
+      case kDTLBMisses:
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = PERF_COUNT_HW_CACHE_DTLB |
+                      (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                      (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        break;
+      default:
+        return -1;
+    }
+    attr.disabled = 1;
+    attr.inherit = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format =
+        PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return static_cast<int>(
+        syscall(__NR_perf_event_open, &attr, 0 /* this process */,
+                -1 /* any cpu */, -1 /* no group */, 0));
+#else
+    return -1;
+#endif
+  }
+
+  int fds_[kNumCounters];
+  double values_[kNumCounters];
+};
+
+}  // namespace benchmark
+
+#endif  // BENCHMARK_CC_PERF_COUNTERS_H_
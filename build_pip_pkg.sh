@@ -71,6 +71,9 @@ function main() {
   rsync -avm -L --exclude='*_test.py' ${PIP_FILE_PREFIX}crop_and_resize_3d_grad_boxes "${TMPDIR}"
   rsync -avm -L --exclude='*_test.py' ${PIP_FILE_PREFIX}crop_and_resize_3d_grad_image "${TMPDIR}"
   rsync -avm -L --exclude='*_test.py' ${PIP_FILE_PREFIX}non_max_suppression_3d "${TMPDIR}"
+  rsync -avm -L --exclude='*_test.py' ${PIP_FILE_PREFIX}roi_pool_3d "${TMPDIR}"
+  rsync -avm -L --exclude='*_test.py' ${PIP_FILE_PREFIX}shared_batch_3d "${TMPDIR}"
+  rsync -avm -L --exclude='*_test.py' ${PIP_FILE_PREFIX}slice_stack_crop "${TMPDIR}"
 
   pushd ${TMPDIR}
   echo $(date) : "=== Building wheel"
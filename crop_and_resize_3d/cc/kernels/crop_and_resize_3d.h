@@ -0,0 +1,177 @@
+#ifndef CROP_AND_RESIZE_3D_CC_KERNELS_CROP_AND_RESIZE_3D_H_
+#define CROP_AND_RESIZE_3D_CC_KERNELS_CROP_AND_RESIZE_3D_H_
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// Sampling code of CropAndResize3D shared with the other crop ops. It only
+// works on raw row-major buffers so that it does not depend on TensorFlow.
+
+namespace tensorflow {
+namespace functor {
+
+// Where one crop sample lies along one image axis: between voxels 'lower' and
+// 'upper', 'lerp' of the way to 'upper', and nearest to voxel 'closest'.
+// Samples falling outside of the image are not 'valid'.
+struct CropAxisSample {
+  bool valid;
+  int lower;
+  int upper;
+  int closest;
+  float lerp;
+};
+
+// Returns true if all n values starting at 'data' are zero, of either sign.
+// The scan goes 8 lanes at a time so the compiler can emit packed compares,
+// and stops at the first block holding a non-zero (or NaN) value. The crop
+// gradients use it to skip upstream gradients that are exact zeros.
+inline bool AllZero(const float* data, int64_t n) {
+  int64_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    bool non_zero = false;
+    for (int k = 0; k < 8; ++k) {
+      non_zero |= (data[i + k] != 0.0f);
+    }
+    if (non_zero) {
+      return false;
+    }
+  }
+  for (; i < n; ++i) {
+    if (data[i] != 0.0f) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Fills the sampling table of the crop_size samples spread evenly between the
+// normalized coordinates 'start' and 'end' of an image axis of image_size
+// voxels. A single sample is taken at the middle of the two.
+inline void ComputeCropAxisSamples(float start, float end, int image_size,
+                                   int crop_size, CropAxisSample* samples) {
+  const float scale =
+      (crop_size > 1) ? (end - start) * (image_size - 1) / (crop_size - 1)
+                      : 0;
+  for (int i = 0; i < crop_size; ++i) {
+    const float in = (crop_size > 1) ? start * (image_size - 1) + i * scale
+                                     : 0.5 * (start + end) * (image_size - 1);
+    CropAxisSample& sample = samples[i];
+    sample.valid = !(in < 0 || in > image_size - 1);
+    if (!sample.valid) {
+      continue;
+    }
+    sample.lower = floorf(in);
+    sample.upper = ceilf(in);
+    sample.closest = roundf(in);
+    sample.lerp = in - sample.lower;
+  }
+}
+
+// Crops 'box' = (y1, x1, z1, y2, x2, z2), in normalized coordinates, out of
+// the [image_height, image_width, image_depth, depth] 'image' and resizes it
+// to the [crop_height, crop_width, crop_depth, depth] 'crop'. Samples falling
+// outside of the image are set to extrapolation_value.
+inline void CropAndResize3DBox(const float* image, int image_height,
+                               int image_width, int image_depth, int depth,
+                               const float* box, int crop_height,
+                               int crop_width, int crop_depth, bool trilinear,
+                               float extrapolation_value, float* crop) {
+  std::vector<CropAxisSample> y_samples(crop_height);
+  std::vector<CropAxisSample> x_samples(crop_width);
+  std::vector<CropAxisSample> z_samples(crop_depth);
+  ComputeCropAxisSamples(box[0], box[3], image_height, crop_height,
+                         y_samples.data());
+  ComputeCropAxisSamples(box[1], box[4], image_width, crop_width,
+                         x_samples.data());
+  ComputeCropAxisSamples(box[2], box[5], image_depth, crop_depth,
+                         z_samples.data());
+
+  // Offsets of consecutive y, x and z samples in the image and in the crop.
+  const int64_t image_z_stride = depth;
+  const int64_t image_x_stride = image_z_stride * image_depth;
+  const int64_t image_y_stride = image_x_stride * image_width;
+  const int64_t crop_z_stride = depth;
+  const int64_t crop_x_stride = crop_z_stride * crop_depth;
+  const int64_t crop_y_stride = crop_x_stride * crop_width;
+
+  for (int y = 0; y < crop_height; ++y) {
+    float* crop_y = crop + y * crop_y_stride;
+    const CropAxisSample& ys = y_samples[y];
+    if (!ys.valid) {
+      for (int64_t i = 0; i < crop_y_stride; ++i) {
+        crop_y[i] = extrapolation_value;
+      }
+      continue;
+    }
+
+    for (int x = 0; x < crop_width; ++x) {
+      float* crop_x = crop_y + x * crop_x_stride;
+      const CropAxisSample& xs = x_samples[x];
+      if (!xs.valid) {
+        for (int64_t i = 0; i < crop_x_stride; ++i) {
+          crop_x[i] = extrapolation_value;
+        }
+        continue;
+      }
+
+      for (int z = 0; z < crop_depth; ++z) {
+        float* out = crop_x + z * crop_z_stride;
+        const CropAxisSample& zs = z_samples[z];
+        if (!zs.valid) {
+          for (int d = 0; d < depth; ++d) {
+            out[d] = extrapolation_value;
+          }
+          continue;
+        }
+
+        if (!trilinear) {
+          const float* in = image + ys.closest * image_y_stride +
+                            xs.closest * image_x_stride +
+                            zs.closest * image_z_stride;
+          for (int d = 0; d < depth; ++d) {
+            out[d] = in[d];
+          }
+          continue;
+        }
+
+        const float y_lerp = ys.lerp;
+        const float x_lerp = xs.lerp;
+        const float z_lerp = zs.lerp;
+        const float* top_left = image + ys.lower * image_y_stride +
+                                xs.lower * image_x_stride;
+        const float* top_right = image + ys.lower * image_y_stride +
+                                 xs.upper * image_x_stride;
+        const float* bottom_left = image + ys.upper * image_y_stride +
+                                   xs.lower * image_x_stride;
+        const float* bottom_right = image + ys.upper * image_y_stride +
+                                    xs.upper * image_x_stride;
+        const int64_t forward = zs.lower * image_z_stride;
+        const int64_t backward = zs.upper * image_z_stride;
+
+        for (int d = 0; d < depth; ++d) {
+          const float top_left_forward = top_left[forward + d];
+          const float top_left_backward = top_left[backward + d];
+          const float top_right_forward = top_right[forward + d];
+          const float top_right_backward = top_right[backward + d];
+          const float bottom_left_forward = bottom_left[forward + d];
+          const float bottom_left_backward = bottom_left[backward + d];
+          const float bottom_right_forward = bottom_right[forward + d];
+          const float bottom_right_backward = bottom_right[backward + d];
+          const float top_left_value = top_left_forward + (top_left_backward - top_left_forward)*z_lerp;
+          const float top_right_value = top_right_forward + (top_right_backward - top_right_forward)*z_lerp;
+          const float bottom_left_value = bottom_left_forward + (bottom_left_backward - bottom_left_forward)*z_lerp;
+          const float bottom_right_value = bottom_right_forward + (bottom_right_backward - bottom_right_forward)*z_lerp;
+          const float top = top_left_value + (top_right_value - top_left_value) * x_lerp;
+          const float bottom = bottom_left_value + (bottom_right_value - bottom_left_value) * x_lerp;
+          out[d] = top + (bottom - top) * y_lerp;
+        }
+      }
+    }
+  }
+}
+
+}  // namespace functor
+}  // namespace tensorflow
+
+#endif  // CROP_AND_RESIZE_3D_CC_KERNELS_CROP_AND_RESIZE_3D_H_
@@ -0,0 +1,152 @@
+#ifndef CROP_AND_RESIZE_3D_CC_KERNELS_CROP_AND_RESIZE_3D_CHECKS_H_
+#define CROP_AND_RESIZE_3D_CC_KERNELS_CROP_AND_RESIZE_3D_CHECKS_H_
+
+#include <vector>
+
+#include "tensorflow/core/framework/bounds_check.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/lib/core/errors.h"
+#include "tensorflow/core/lib/core/status.h"
+
+// Input checks shared by the kernels of the crop ops and of their gradients.
+
+namespace tensorflow {
+
+inline Status ParseAndCheckBoxSizes(const Tensor& boxes,
+                                    const Tensor& box_index, int* num_boxes) {
+  if (boxes.NumElements() == 0 && box_index.NumElements() == 0) {
+    *num_boxes = 0;
+    return Status::OK();
+  }
+  // The shape of 'boxes' is [num_boxes, 6].
+  if (boxes.dims() != 2) {
+    return errors::InvalidArgument("boxes must be 2-D",
+                                   boxes.shape().DebugString());
+  }
+  *num_boxes = boxes.dim_size(0);
+  if (boxes.dim_size(1) != 6) {
+    return errors::InvalidArgument("boxes must have 6 columns");
+  }
+  // The shape of 'box_index' is [num_boxes].
+  if (box_index.dims() != 1) {
+    return errors::InvalidArgument("box_index must be 1-D",
+                                   box_index.shape().DebugString());
+  }
+  if (box_index.dim_size(0) != *num_boxes) {
+    return errors::InvalidArgument("box_index has incompatible shape");
+  }
+  return Status::OK();
+}
+
+inline Status CheckBoxIndexRange(const Tensor& box_index, int num_boxes,
+                                 int batch_size) {
+  auto box_indexT = box_index.tensor<int32, 1>();
+  for (int b = 0; b < num_boxes; ++b) {
+    if (!FastBoundsCheck(box_indexT(b), batch_size)) {
+      return errors::InvalidArgument(
+          "box_index has values outside [0, batch_size)");
+    }
+  }
+  return Status::OK();
+}
+
+// Marks which of the num_boxes boxes are real rather than padding. A scalar
+// 'num_valid' keeps the first num_valid boxes, a vector keeps, for every image
+// b, the first num_valid[b] boxes whose box_index is b. Negative counts keep
+// every box.
+inline Status ParseAndCheckNumValid(const Tensor& num_valid,
+                                    const Tensor& box_index, int batch_size,
+                                    int num_boxes,
+                                    std::vector<bool>* box_is_valid) {
+  box_is_valid->assign(num_boxes, true);
+  if (num_valid.dims() == 0) {
+    const int count = num_valid.scalar<int32>()();
+    if (count >= 0) {
+      for (int b = count; b < num_boxes; ++b) {
+        (*box_is_valid)[b] = false;
+      }
+    }
+    return Status::OK();
+  }
+  // The shape of 'num_valid' is [batch_size].
+  if (num_valid.dims() != 1 || num_valid.dim_size(0) != batch_size) {
+    return errors::InvalidArgument(
+        "num_valid must be a scalar or have one entry per image",
+        num_valid.shape().DebugString());
+  }
+  auto num_validT = num_valid.tensor<int32, 1>();
+  auto box_indexT = box_index.tensor<int32, 1>();
+  std::vector<int> boxes_seen(batch_size, 0);
+  for (int b = 0; b < num_boxes; ++b) {
+    const int32 b_in = box_indexT(b);
+    if (!FastBoundsCheck(b_in, batch_size)) {
+      return errors::InvalidArgument(
+          "box_index has values outside [0, batch_size)");
+    }
+    if (num_validT(b_in) >= 0 && boxes_seen[b_in] >= num_validT(b_in)) {
+      (*box_is_valid)[b] = false;
+    }
+    ++boxes_seen[b_in];
+  }
+  return Status::OK();
+}
+
+// Sizes of the inputs of CropAndResize3D.
+struct CropAndResize3DSizes {
+  int batch_size = 0;
+  int image_height = 0;
+  int image_width = 0;
+  int image_depth = 0;
+  int depth = 0;
+  int num_boxes = 0;
+  int crop_height = 0;
+  int crop_width = 0;
+  int crop_depth = 0;
+};
+
+// Checks the inputs of CropAndResize3D and of its batched variants, and
+// parses their sizes and which boxes are padding.
+inline Status ParseAndCheckCropAndResize3DInputs(
+    const Tensor& image, const Tensor& boxes, const Tensor& box_index,
+    const Tensor& crop_size, const Tensor& num_valid,
+    CropAndResize3DSizes* sizes, std::vector<bool>* box_is_valid) {
+  if (image.dims() != 5) {
+    return errors::InvalidArgument("input image must be 5-D",
+                                   image.shape().DebugString());
+  }
+  sizes->batch_size = image.dim_size(0);
+  sizes->image_height = image.dim_size(1);
+  sizes->image_width = image.dim_size(2);
+  sizes->image_depth = image.dim_size(3);
+  sizes->depth = image.dim_size(4);
+  if (sizes->image_height <= 0 || sizes->image_width <= 0 ||
+      sizes->image_depth <= 0) {
+    return errors::InvalidArgument("image dimensions must be positive");
+  }
+  TF_RETURN_IF_ERROR(
+      ParseAndCheckBoxSizes(boxes, box_index, &sizes->num_boxes));
+  TF_RETURN_IF_ERROR(
+      CheckBoxIndexRange(box_index, sizes->num_boxes, sizes->batch_size));
+  if (crop_size.dims() != 1) {
+    return errors::InvalidArgument("crop_size must be 1-D",
+                                   crop_size.shape().DebugString());
+  }
+  if (crop_size.dim_size(0) != 3) {
+    return errors::InvalidArgument("crop_size must have three elements",
+                                   crop_size.shape().DebugString());
+  }
+  auto crop_size_vec = crop_size.vec<int32>();
+  sizes->crop_height = internal::SubtleMustCopy(crop_size_vec(0));
+  sizes->crop_width = internal::SubtleMustCopy(crop_size_vec(1));
+  sizes->crop_depth = internal::SubtleMustCopy(crop_size_vec(2));
+  if (sizes->crop_height <= 0 || sizes->crop_width <= 0 ||
+      sizes->crop_depth <= 0) {
+    return errors::InvalidArgument("crop dimensions must be positive");
+  }
+  return ParseAndCheckNumValid(num_valid, box_index, sizes->batch_size,
+                               sizes->num_boxes, box_is_valid);
+}
+
+}  // namespace tensorflow
+
+#endif  // CROP_AND_RESIZE_3D_CC_KERNELS_CROP_AND_RESIZE_3D_CHECKS_H_
@@ -51,6 +51,7 @@ REGISTER_OP("CropAndResize3D")
     .Input("boxes: float")
     .Input("box_index: int32")
     .Input("crop_size: int32")
+    .Input("num_valid: int32")
     .Output("crops: float")
     .Attr("T: {uint8, uint16, int8, int16, int32, int64, half, float, double}")
     .Attr("method_name: {'trilinear', 'nearest'} = 'trilinear'")
@@ -73,6 +74,10 @@ REGISTER_OP("CropAndResize3D")
       ::tensorflow::shape_inference::DimensionHandle unused;
       TF_RETURN_IF_ERROR(c->WithValue(c->Dim(boxes, 1), 6, &unused));
 
+      // num_valid is a scalar or holds one count per image.
+      ::tensorflow::shape_inference::ShapeHandle num_valid;
+      TF_RETURN_IF_ERROR(c->WithRankAtMost(c->input(4), 1, &num_valid));
+
       return SetOutputToSizedImage(c, num_boxes_dim, 3 /* size_input_idx */,
                                    c->Dim(input, 4));
     });
\ No newline at end of file
@@ -5,4 +5,17 @@ from tensorflow.python.platform import resource_loader
 crop_and_resize_3d_ops = load_library.load_op_library(
     resource_loader.get_path_to_datafile('_crop_and_resize_3d_ops.so'))
 
-crop_and_resize_3d = crop_and_resize_3d_ops.crop_and_resize3d
\ No newline at end of file
+
+def crop_and_resize_3d(image, boxes, box_index, crop_size,
+                       method_name='trilinear', extrapolation_value=0,
+                       num_valid=-1, name=None):
+    """Crops and resizes `boxes` out of `image`.
+
+    `num_valid` is a scalar or holds one count per image. Boxes beyond the
+    first `num_valid` ones (of their image) are treated as padding and filled
+    with `extrapolation_value`. A negative count keeps every box.
+    """
+    return crop_and_resize_3d_ops.crop_and_resize3d(
+        image, boxes, box_index, crop_size, num_valid,
+        method_name=method_name, extrapolation_value=extrapolation_value,
+        name=name)
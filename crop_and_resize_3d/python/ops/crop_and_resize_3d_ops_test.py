@@ -456,4 +456,48 @@ try:
     results = crop_and_resize_3d(image, boxes, box_index, crop_size)
 except Exception as e:
     if 'box_index has values outside [0, batch_size)' in str(e):
-        print('TestInvalidBoxIndex is OK.')
\ No newline at end of file
+        print('TestInvalidBoxIndex is OK.')
+
+#TestCropAndResizePaddedBoxes
+image = np.empty((1,2,2,2,1))
+image[0,:,:,:,0] = np.array([[[1,2],[3,4]],[[5,6],[7,8]]])
+boxes = np.zeros((4,6))
+boxes[0] = np.array([0,0,0,1,1,1])
+boxes[1] = np.array([1,1,1,0,0,0])
+box_index = np.zeros((4))
+crop_size = np.array([3,3,3])
+
+scipy_control = crop_and_resize_from_scipy(image, boxes[:2], crop_size)
+
+image = tf.dtypes.cast(image, tf.float32)
+boxes = tf.dtypes.cast(boxes, tf.float32)
+box_index = tf.dtypes.cast(box_index, tf.int32)
+crop_size = tf.dtypes.cast(crop_size, tf.int32)
+
+results = crop_and_resize_3d(image, boxes, box_index, crop_size, extrapolation_value=-1, num_valid=2)
+results_per_image = crop_and_resize_3d(image, boxes, box_index, crop_size, extrapolation_value=-1, num_valid=[2])
+
+if results.shape == (4, 3, 3, 3, 1) and np.allclose(results.numpy()[:2], scipy_control) \
+        and (results.numpy()[2:] == -1).all() and (results_per_image.numpy() == results.numpy()).all():
+    print('TestCropAndResizePaddedBoxes is OK.')
+else:
+    print('TestCropAndResizePaddedBoxes is not OK.')
+
+
+#TestCropAndResizeNearestDepthDiffersFromWidth
+image = np.arange(36, dtype=np.float32).reshape((1, 3, 3, 4, 1))
+boxes = tf.constant([[0, 0, 0, 1, 1, 1]], tf.float32)
+box_index = tf.constant([0], tf.int32)
+# Nearest samples of the full box: crops of 2 and 3 voxels along axes of 3
+# and 4 voxels sample voxels (0, 2) and (0, 1, 2) or (0, 3) and (0, 2, 3).
+samples = {(3, 2): [0, 2], (3, 3): [0, 1, 2], (4, 2): [0, 3], (4, 3): [0, 2, 3]}
+ok = True
+for crop_size in [[2, 2, 3], [2, 3, 2]]:
+    control = image[0][np.ix_(samples[(3, crop_size[0])], samples[(3, crop_size[1])], samples[(4, crop_size[2])])]
+    results = crop_and_resize_3d(tf.constant(image), boxes, box_index, tf.constant(crop_size, tf.int32),
+                                 method_name='nearest')
+    ok = ok and results.shape == (1, *crop_size, 1) and (results.numpy()[0] == control).all()
+if ok:
+    print('TestCropAndResizeNearestDepthDiffersFromWidth is OK.')
+else:
+    print('TestCropAndResizeNearestDepthDiffersFromWidth is not OK.')
@@ -1,32 +1,43 @@
+#include "crop_and_resize_3d/cc/kernels/crop_and_resize_3d.h"
+#include "crop_and_resize_3d/cc/kernels/crop_and_resize_3d_checks.h"
+
 #include "tensorflow/core/framework/op_kernel.h"
+#include "tensorflow/core/framework/bounds_check.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
 
 using namespace tensorflow;
 
-static inline Status ParseAndCheckBoxSizes(const Tensor& boxes,
-                                           const Tensor& box_index,
-                                           int* num_boxes) {
-  if (boxes.NumElements() == 0 && box_index.NumElements() == 0) {
-    *num_boxes = 0;
-    return Status::OK();
-  }
-  // The shape of 'boxes' is [num_boxes, 6].
-  if (boxes.dims() != 2) {
-    return errors::InvalidArgument("boxes must be 2-D",
-                                   boxes.shape().DebugString());
-  }
-  *num_boxes = boxes.dim_size(0);
-  if (boxes.dim_size(1) != 6) {
-    return errors::InvalidArgument("boxes must have 6 columns");
+// Fills 'sample' for the coordinate 'in' of an image axis of 'size' voxels.
+static inline void SampleAxis(float in, int size,
+                              functor::CropAxisSample* sample) {
+  sample->valid = !(in < 0 || in > size - 1);
+  if (!sample->valid) {
+    return;
   }
-  // The shape of 'box_index' is [num_boxes].
-  if (box_index.dims() != 1) {
-    return errors::InvalidArgument("box_index must be 1-D",
-                                   box_index.shape().DebugString());
-  }
-  if (box_index.dim_size(0) != *num_boxes) {
-    return errors::InvalidArgument("box_index has incompatible shape");
+  sample->lower = floorf(in);
+  sample->upper = ceilf(in);
+  sample->closest = roundf(in);
+  sample->lerp = in - sample->lower;
+}
+
+// Sets 'indices' to the voxels the valid 'samples' interpolate between, in
+// increasing order and without duplicates.
+static inline void SampledIndices(
+    const std::vector<functor::CropAxisSample>& samples,
+    std::vector<int>* indices) {
+  indices->clear();
+  for (const functor::CropAxisSample& sample : samples) {
+    if (sample.valid) {
+      indices->push_back(sample.lower);
+      indices->push_back(sample.upper);
+    }
   }
-  return Status::OK();
+  std::sort(indices->begin(), indices->end());
+  indices->erase(std::unique(indices->begin(), indices->end()),
+                 indices->end());
 }
 
 class CropAndResize3DGradBoxesOp : public OpKernel {
@@ -43,6 +54,7 @@ public:
     const Tensor& image = context-> input(1);
     const Tensor& boxes = context-> input(2);
     const Tensor& box_index = context-> input(3);
+    const Tensor& num_valid = context-> input(4);
 
     OP_REQUIRES(context, grads.dims() == 5,
                       errors::InvalidArgument("grads image must be 5-D",
@@ -73,10 +85,16 @@ public:
 
     int num_boxes = 0;
     OP_REQUIRES_OK(context, ParseAndCheckBoxSizes(boxes, box_index, &num_boxes));
+    OP_REQUIRES_OK(context,
+                   CheckBoxIndexRange(box_index, num_boxes, batch_size));
 
     OP_REQUIRES(
         context, grads.dim_size(0) == num_boxes,
         errors::InvalidArgument("boxes and grads have incompatible shape"));
+    std::vector<bool> box_is_valid;
+    OP_REQUIRES_OK(context, ParseAndCheckNumValid(num_valid, box_index,
+                                                  batch_size, num_boxes,
+                                                  &box_is_valid));
 
     Tensor* output = NULL;
     OP_REQUIRES_OK(context, context->allocate_output(0, TensorShape({num_boxes, 6}), &output));
@@ -89,7 +107,26 @@ public:
 
     grads_boxes.setZero();
 
+    // Boxes, y slices and voxels whose upstream gradient is all zeros only
+    // add zeros to grads_boxes, so they are skipped without changing the
+    // result of the dense pass. This only holds when the image voxels the box
+    // interpolates between are finite: the dense pass turns 0 * inf and
+    // 0 * NaN into NaN. Only these voxels are checked, at most once per box,
+    // the first time one of its gradients is zero.
+    const int64 slice_size = static_cast<int64>(crop_width) * crop_depth * depth;
+    const int64 box_size = crop_height * slice_size;
+    std::vector<functor::CropAxisSample> y_samples(crop_height);
+    std::vector<functor::CropAxisSample> x_samples(crop_width);
+    std::vector<functor::CropAxisSample> z_samples(crop_depth);
+    std::vector<int> y_indices, x_indices, z_indices;
+
     for (int b = 0; b < num_boxes; ++b) {
+      // Padded boxes keep the zero gradient set above.
+      if (!box_is_valid[b]) {
+        continue;
+      }
+      const int32 b_in = box_indexT(b);
+
       const float y1 = boxesT(b, 0);
       const float x1 = boxesT(b, 1);
       const float z1 = boxesT(b, 2);
@@ -97,8 +134,6 @@ public:
       const float x2 = boxesT(b, 4);
       const float z2 = boxesT(b, 5);
 
-      const int32 b_in = box_indexT(b);
-
       const float height_ratio =
           (crop_height > 1) ? static_cast<float>(image_height - 1) / (crop_height - 1)
               : 0;
@@ -114,37 +149,78 @@ public:
       const float depth_scale = (crop_depth > 1) ? (z2 - y1) * height_ratio : 0;
 
       for (int y = 0; y < crop_height; ++y) {
-        const float in_y = (crop_height > 1)
-                               ? y1 * (image_height - 1) + y * height_scale
-                               : 0.5 * (y1 + y2) * (image_height - 1);
-        if (in_y < 0 || in_y > image_height - 1) {
+        SampleAxis((crop_height > 1) ? y1 * (image_height - 1) + y * height_scale
+                                     : 0.5 * (y1 + y2) * (image_height - 1),
+                   image_height, &y_samples[y]);
+      }
+      for (int x = 0; x < crop_width; ++x) {
+        SampleAxis((crop_width > 1) ? x1 * (image_width - 1) + x * width_scale
+                                    : 0.5 * (x1 + x2) * (image_width - 1),
+                   image_width, &x_samples[x]);
+      }
+      for (int z = 0; z < crop_depth; ++z) {
+        SampleAxis((crop_depth > 1) ? z1 * (image_depth - 1) + z * depth_scale
+                                    : 0.5 * (z1 + z2) * (image_depth - 1),
+                   image_depth, &z_samples[z]);
+      }
+
+      int box_is_finite = -1;
+      auto is_finite = [&]() {
+        if (box_is_finite < 0) {
+          SampledIndices(y_samples, &y_indices);
+          SampledIndices(x_samples, &x_indices);
+          SampledIndices(z_samples, &z_indices);
+          box_is_finite = 1;
+          for (int y : y_indices) {
+            for (int x : x_indices) {
+              for (int z : z_indices) {
+                const float* voxel = &imageT(b_in, y, x, z, 0);
+                if (!std::all_of(voxel, voxel + depth,
+                                 [](float v) { return std::isfinite(v); })) {
+                  box_is_finite = 0;
+                  return false;
+                }
+              }
+            }
+          }
+        }
+        return box_is_finite == 1;
+      };
+
+      if (functor::AllZero(&gradsT(b, 0, 0, 0, 0), box_size) && is_finite()) {
+        continue;
+      }
+
+      for (int y = 0; y < crop_height; ++y) {
+        const functor::CropAxisSample& ys = y_samples[y];
+        if (!ys.valid ||
+            (functor::AllZero(&gradsT(b, y, 0, 0, 0), slice_size) &&
+             is_finite())) {
           continue;
         }
-        const int top_y_index = floorf(in_y);
-        const int bottom_y_index = ceilf(in_y);
-        const float y_lerp = in_y - top_y_index;
+        const int top_y_index = ys.lower;
+        const int bottom_y_index = ys.upper;
+        const float y_lerp = ys.lerp;
 
         for (int x = 0; x < crop_width; ++x) {
-          const float in_x = (crop_width > 1)
-                                 ? x1 * (image_width - 1) + x * width_scale
-                                 : 0.5 * (x1 + x2) * (image_width - 1);
-          if (in_x < 0 || in_x > image_width - 1) {
+          const functor::CropAxisSample& xs = x_samples[x];
+          if (!xs.valid) {
             continue;
           }
-          const int left_x_index = floorf(in_x);
-          const int right_x_index = ceilf(in_x);
-          const float x_lerp = in_x - left_x_index;
+          const int left_x_index = xs.lower;
+          const int right_x_index = xs.upper;
+          const float x_lerp = xs.lerp;
 
           for (int z = 0; z < crop_depth; ++z) {
-            const float in_z = (crop_depth > 1)
-                                   ? z1 * (image_depth - 1) + z * depth_scale
-                                   : 0.5 * (z1 + z2) * (image_depth - 1);
-            if (in_z < 0 || in_z > image_depth - 1) {
+            const functor::CropAxisSample& zs = z_samples[z];
+            if (!zs.valid ||
+                (functor::AllZero(&gradsT(b, y, x, z, 0), depth) &&
+                 is_finite())) {
               continue;
             }
-            const int forward_z_index = floorf(in_z);
-            const int backward_z_index = ceilf(in_z);
-            const float z_lerp = in_z - forward_z_index;
+            const int forward_z_index = zs.lower;
+            const int backward_z_index = zs.upper;
+            const float z_lerp = zs.lerp;
 
             for (int d = 0; d < depth; ++d) {
               const float top_left_forward(static_cast<float>(
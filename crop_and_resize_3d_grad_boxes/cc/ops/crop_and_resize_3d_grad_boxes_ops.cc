@@ -8,10 +8,13 @@ REGISTER_OP("CropAndResize3DGradBoxes")
     .Input("image: T")
     .Input("boxes: float")
     .Input("box_ind: int32")
+    .Input("num_valid: int32")
     .Output("output: float")
     .Attr("T: {uint8, uint16, int8, int16, int32, int64, half, float, double}")
     .Attr("method_name: {'trilinear'} = 'trilinear'")
     .SetShapeFn([](::tensorflow::shape_inference::InferenceContext* c) {
+      ::tensorflow::shape_inference::ShapeHandle num_valid;
+      TF_RETURN_IF_ERROR(c->WithRankAtMost(c->input(4), 1, &num_valid));
       c->set_output(0, c->input(2));
       return Status::OK();
     });
\ No newline at end of file
@@ -5,4 +5,14 @@ from tensorflow.python.platform import resource_loader
 crop_and_resize_3d_grad_boxes_ops = load_library.load_op_library(
     resource_loader.get_path_to_datafile('_crop_and_resize_3d_grad_boxes_ops.so'))
 
-crop_and_resize_3d_grad_boxes = crop_and_resize_3d_grad_boxes_ops.crop_and_resize3d_grad_boxes
\ No newline at end of file
+
+def crop_and_resize_3d_grad_boxes(grads, image, boxes, box_ind,
+                                  method_name='trilinear', num_valid=-1,
+                                  name=None):
+    """Gradient of crop_and_resize_3d with respect to the boxes.
+
+    Padded boxes, as described by `num_valid`, get a zero gradient.
+    """
+    return crop_and_resize_3d_grad_boxes_ops.crop_and_resize3d_grad_boxes(
+        grads, image, boxes, box_ind, num_valid, method_name=method_name,
+        name=name)
@@ -0,0 +1,124 @@
+import os
+import numpy as np
+import tensorflow as tf
+
+from crop_and_resize_3d_grad_boxes import crop_and_resize_3d_grad_boxes
+
+# Comment the following line to debug TF or libcuda issues
+os.environ['TF_CPP_MIN_LOG_LEVEL'] = '3'
+
+
+def axis_samples(start, end, image_size, crop_size):
+    # Image coordinate of every crop sample along one axis, None outside.
+    scale = (end - start) * (image_size - 1) / (crop_size - 1)
+    coords = [start * (image_size - 1) + i * scale for i in range(crop_size)]
+    return [c if 0 <= c <= image_size - 1 else None for c in coords]
+
+
+def dense_grad_boxes_from_numpy(grads, image, boxes, box_index):
+    # Accumulates every sample of every box, zero gradients included, so that
+    # 0 * inf and 0 * NaN give NaN. Every crop dimension must be above 1.
+    grads_boxes = np.zeros((np.shape(boxes)[0], 6))
+    image_size = np.shape(image)[1:4]
+    crop_size = np.shape(grads)[1:4]
+    ratios = [(image_size[a] - 1) / (crop_size[a] - 1) for a in range(3)]
+    for b in range(np.shape(boxes)[0]):
+        samples = [axis_samples(boxes[b, a], boxes[b, a + 3], image_size[a], crop_size[a]) for a in range(3)]
+        for y, in_y in enumerate(samples[0]):
+            for x, in_x in enumerate(samples[1]):
+                for z, in_z in enumerate(samples[2]):
+                    if in_y is None or in_x is None or in_z is None:
+                        continue
+                    ys = [int(np.floor(in_y)), int(np.ceil(in_y))]
+                    xs = [int(np.floor(in_x)), int(np.ceil(in_x))]
+                    zs = [int(np.floor(in_z)), int(np.ceil(in_z))]
+                    ly, lx, lz = in_y - ys[0], in_x - xs[0], in_z - zs[0]
+                    v = [[[image[box_index[b], ys[i], xs[j], zs[k]] for k in range(2)] for j in range(2)]
+                         for i in range(2)]
+                    grad_y = ((1 - lz) * ((1 - lx) * (v[1][0][0] - v[0][0][0]) + lx * (v[1][1][0] - v[0][1][0])) +
+                              lz * ((1 - lx) * (v[1][0][1] - v[0][0][1]) + lx * (v[1][1][1] - v[0][1][1])))
+                    grad_x = ((1 - lz) * ((1 - ly) * (v[0][1][0] - v[0][0][0]) + ly * (v[1][1][0] - v[1][0][0])) +
+                              lz * ((1 - ly) * (v[0][1][1] - v[0][0][1]) + ly * (v[1][1][1] - v[1][0][1])))
+                    grad_z = ((1 - lx) * ((1 - ly) * (v[0][0][1] - v[0][0][0]) + ly * (v[1][0][1] - v[1][0][0])) +
+                              lx * ((1 - ly) * (v[0][1][1] - v[0][1][0]) + ly * (v[1][1][1] - v[1][1][0])))
+                    g = grads[b, y, x, z]
+                    for axis, grad, i in [(0, grad_y, y), (1, grad_x, x), (2, grad_z, z)]:
+                        grads_boxes[b, axis] += np.sum(grad * g * (image_size[axis] - 1 - i * ratios[axis]))
+                        grads_boxes[b, axis + 3] += np.sum(grad * g * i * ratios[axis])
+    return grads_boxes
+
+
+np.random.seed(0)
+# Boxes have y1 == z1 over equal image heights and depths and equal crop
+# heights and depths, the only boxes for which the depth scale of the kernel
+# is that of crop_and_resize_3d.
+image = np.random.rand(2, 6, 7, 6, 2)
+boxes = np.array([[0.1, 0.2, 0.1, 0.8, 0.9, 0.7], [0, 0, 0, 1, 1, 1],
+                  [0.3, 0.1, 0.3, 0.6, 0.5, 0.9], [0.2, 0.1, 0.2, 0.9, 0.8, 1]])
+box_index = np.array([0, 1, 1, 0])
+grads = np.random.rand(4, 4, 5, 4, 2)
+# Zero whole boxes, y slices and voxels so that every skip is taken.
+grads[1] = 0
+grads[2, 1:3] = 0
+grads[3, :, 2] = 0
+grads[0, 0, 0, 0] = 0
+
+#TestSparseMatchesDense
+control = dense_grad_boxes_from_numpy(grads, image, boxes, box_index)
+results = crop_and_resize_3d_grad_boxes(tf.constant(grads, tf.float32), tf.constant(image, tf.float32),
+                                        tf.constant(boxes, tf.float32), tf.constant(box_index, tf.int32))
+if results.shape == control.shape and np.allclose(results.numpy(), control, rtol=1e-4, atol=1e-4):
+    print('TestSparseMatchesDense is OK.')
+else:
+    print('TestSparseMatchesDense is not OK.')
+
+#TestSparseMatchesDenseWithNaN
+# Box 1 has a zero gradient but samples the NaN voxel, so that its gradient
+# is NaN as in the dense pass.
+nan_image = image.copy()
+nan_image[1, 2, 3, 2, 0] = np.nan
+control = dense_grad_boxes_from_numpy(grads, nan_image, boxes, box_index)
+results = crop_and_resize_3d_grad_boxes(tf.constant(grads, tf.float32), tf.constant(nan_image, tf.float32),
+                                        tf.constant(boxes, tf.float32), tf.constant(box_index, tf.int32))
+if (np.isnan(results.numpy()[1]).any() and
+        np.allclose(results.numpy(), control, rtol=1e-4, atol=1e-4, equal_nan=True)):
+    print('TestSparseMatchesDenseWithNaN is OK.')
+else:
+    print('TestSparseMatchesDenseWithNaN is not OK.')
+
+#TestZeroGradientBoxSkippedWithNaNOutside
+# Box 2 has a zero gradient and the NaN voxel of its image lies outside of
+# the voxels it samples, so its gradient stays exactly zero. Box 1 samples
+# the whole image, NaN voxel included, so its gradient is NaN.
+outside_image = image.copy()
+outside_image[1, 5, 6, 5, 0] = np.nan
+outside_grads = grads.copy()
+outside_grads[2] = 0
+control = dense_grad_boxes_from_numpy(outside_grads, outside_image, boxes, box_index)
+results = crop_and_resize_3d_grad_boxes(tf.constant(outside_grads, tf.float32), tf.constant(outside_image, tf.float32),
+                                        tf.constant(boxes, tf.float32), tf.constant(box_index, tf.int32))
+if ((results.numpy()[2] == 0).all() and np.isnan(results.numpy()[1]).any() and
+        np.allclose(results.numpy(), control, rtol=1e-4, atol=1e-4, equal_nan=True)):
+    print('TestZeroGradientBoxSkippedWithNaNOutside is OK.')
+else:
+    print('TestZeroGradientBoxSkippedWithNaNOutside is not OK.')
+
+#TestPaddedBoxes
+# Padding boxes with non-zero gradients follow the real ones: keeping the
+# first four boxes, or the first two boxes of each image, zeroes their
+# gradient and leaves that of the real boxes unchanged.
+pad_boxes = np.concatenate([boxes, np.random.rand(3, 6)])
+pad_box_index = np.concatenate([box_index, [1, 0, 1]])
+pad_grads = np.concatenate([grads, np.random.rand(3, *np.shape(grads)[1:])])
+control = dense_grad_boxes_from_numpy(grads, image, boxes, box_index)
+ok = True
+for num_valid in [4, [2, 2]]:
+    results = crop_and_resize_3d_grad_boxes(tf.constant(pad_grads, tf.float32), tf.constant(image, tf.float32),
+                                            tf.constant(pad_boxes, tf.float32), tf.constant(pad_box_index, tf.int32),
+                                            num_valid=num_valid)
+    ok = (ok and results.shape == (7, 6) and (results.numpy()[4:] == 0).all() and
+          np.allclose(results.numpy()[:4], control, rtol=1e-4, atol=1e-4))
+if ok:
+    print('TestPaddedBoxes is OK.')
+else:
+    print('TestPaddedBoxes is not OK.')
\ No newline at end of file
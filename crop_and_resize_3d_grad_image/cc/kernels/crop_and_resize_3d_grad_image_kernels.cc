@@ -1,34 +1,13 @@
+#include "crop_and_resize_3d/cc/kernels/crop_and_resize_3d.h"
+#include "crop_and_resize_3d/cc/kernels/crop_and_resize_3d_checks.h"
+
 #include "tensorflow/core/framework/op_kernel.h"
 #include "tensorflow/core/framework/bounds_check.h"
 
-using namespace tensorflow;
+#include <algorithm>
+#include <vector>
 
-static inline Status ParseAndCheckBoxSizes(const Tensor& boxes,
-                                           const Tensor& box_index,
-                                           int* num_boxes) {
-  if (boxes.NumElements() == 0 && box_index.NumElements() == 0) {
-    *num_boxes = 0;
-    return Status::OK();
-  }
-  // The shape of 'boxes' is [num_boxes, 6].
-  if (boxes.dims() != 2) {
-    return errors::InvalidArgument("boxes must be 2-D",
-                                   boxes.shape().DebugString());
-  }
-  *num_boxes = boxes.dim_size(0);
-  if (boxes.dim_size(1) != 6) {
-    return errors::InvalidArgument("boxes must have 6 columns");
-  }
-  // The shape of 'box_index' is [num_boxes].
-  if (box_index.dims() != 1) {
-    return errors::InvalidArgument("box_index must be 1-D",
-                                   box_index.shape().DebugString());
-  }
-  if (box_index.dim_size(0) != *num_boxes) {
-    return errors::InvalidArgument("box_index has incompatible shape");
-  }
-  return Status::OK();
-}
+using namespace tensorflow;
 
 class CropAndResize3DGradImageOp : public OpKernel {
 public:
@@ -44,6 +23,7 @@ public:
     const Tensor& boxes = context-> input(1);
     const Tensor& box_index = context-> input(2);
     const Tensor& image_size = context-> input(3);
+    const Tensor& num_valid = context-> input(4);
 
     OP_REQUIRES(context, grads.dims() == 5,
                       errors::InvalidArgument("grads image must be 5-D",
@@ -58,6 +38,9 @@ public:
     int num_boxes = 0;
     OP_REQUIRES_OK(
         context, ParseAndCheckBoxSizes(boxes, box_index, &num_boxes));
+    OP_REQUIRES(
+        context, grads.dim_size(0) == num_boxes,
+        errors::InvalidArgument("boxes and grads have incompatible shape"));
     OP_REQUIRES(context, image_size.dims() == 1,
                       errors::InvalidArgument("image_size must be 1-D",
                                               image_size.shape().DebugString()));
@@ -78,6 +61,10 @@ public:
     OP_REQUIRES(
         context, grads.dim_size(4) == depth,
         errors::InvalidArgument("image_size and grads are incompatible"));
+    std::vector<bool> box_is_valid;
+    OP_REQUIRES_OK(context, ParseAndCheckNumValid(num_valid, box_index,
+                                                  batch_size, num_boxes,
+                                                  &box_is_valid));
 
     Tensor* output = NULL;
     OP_REQUIRES_OK(context, context->allocate_output(0, TensorShape({batch_size,
@@ -89,7 +76,19 @@ public:
 
     grads_image.setZero();
 
+    // Upstream gradients are often exact zeros (e.g. a mask loss restricted
+    // to positive boxes). Such boxes, y slices and voxels would only scatter
+    // zeros, so they are skipped. The interpolation weights are finite for
+    // finite boxes, so the result is the same as the dense pass.
+    const int64 slice_size = static_cast<int64>(crop_width) * crop_depth * depth;
+    const int64 box_size = crop_height * slice_size;
+
     for (int b = 0; b < num_boxes; ++b) {
+      // Padded boxes contribute nothing to the zeroed image gradient.
+      if (!box_is_valid[b] || functor::AllZero(&gradsT(b, 0, 0, 0, 0), box_size)) {
+        continue;
+      }
+
       const float y1 = boxesT(b, 0);
       const float x1 = boxesT(b, 1);
       const float z1 = boxesT(b, 2);
@@ -110,6 +109,9 @@ public:
                        : 0;
 
       for (int y = 0; y < crop_height; ++y) {
+        if (functor::AllZero(&gradsT(b, y, 0, 0, 0), slice_size)) {
+          continue;
+        }
         const float in_y = (crop_height > 1)
                                ? y1 * (image_height - 1) + y * height_scale
                                : 0.5 * (y1 + y2) * (image_height - 1);
@@ -135,7 +137,8 @@ public:
             const float in_z = (crop_depth > 1)
                                    ? z1 * (image_depth - 1) + z * depth_scale
                                    : 0.5 * (z1 + z2) * (image_depth - 1);
-            if (in_z < 0 || in_z > image_depth - 1) {
+            if (in_z < 0 || in_z > image_depth - 1 ||
+                functor::AllZero(&gradsT(b, y, x, z, 0), depth)) {
               continue;
             }
             if (method_name_ == "trilinear") {
@@ -8,6 +8,7 @@ REGISTER_OP("CropAndResize3DGradImage")
     .Input("boxes: float")
     .Input("box_ind: int32")
     .Input("image_size: int32")
+    .Input("num_valid: int32")
     .Output("output: T")
     .Attr("T: {float, half, double}")
     .Attr("method_name: {'trilinear', 'nearest'} = 'trilinear'")
@@ -15,6 +16,8 @@ REGISTER_OP("CropAndResize3DGradImage")
       ::tensorflow::shape_inference::ShapeHandle out;
       TF_RETURN_IF_ERROR(c->MakeShapeFromShapeTensor(3, &out));
       TF_RETURN_IF_ERROR(c->WithRank(out, 5, &out));
+      ::tensorflow::shape_inference::ShapeHandle num_valid;
+      TF_RETURN_IF_ERROR(c->WithRankAtMost(c->input(4), 1, &num_valid));
       c->set_output(0, out);
       return Status::OK();
     });
\ No newline at end of file
@@ -5,5 +5,14 @@ from tensorflow.python.platform import resource_loader
 crop_and_resize_3d_grad_image_ops = load_library.load_op_library(
     resource_loader.get_path_to_datafile('_crop_and_resize_3d_grad_image_ops.so'))
 
-crop_and_resize_3d_grad_image = crop_and_resize_3d_grad_image_ops.crop_and_resize3d_grad_image
 
+def crop_and_resize_3d_grad_image(grads, boxes, box_ind, image_size, T,
+                                  method_name='trilinear', num_valid=-1,
+                                  name=None):
+    """Gradient of crop_and_resize_3d with respect to the image.
+
+    Padded boxes, as described by `num_valid`, contribute no gradient.
+    """
+    return crop_and_resize_3d_grad_image_ops.crop_and_resize3d_grad_image(
+        grads, boxes, box_ind, image_size, num_valid, T=T,
+        method_name=method_name, name=name)
@@ -0,0 +1,102 @@
+import os
+import numpy as np
+import tensorflow as tf
+
+from crop_and_resize_3d_grad_image import crop_and_resize_3d_grad_image
+
+# Comment the following line to debug TF or libcuda issues
+os.environ['TF_CPP_MIN_LOG_LEVEL'] = '3'
+
+
+def axis_samples(start, end, image_size, crop_size):
+    # Image coordinate of every crop sample along one axis, None outside.
+    if crop_size > 1:
+        scale = (end - start) * (image_size - 1) / (crop_size - 1)
+        coords = [start * (image_size - 1) + i * scale for i in range(crop_size)]
+    else:
+        coords = [0.5 * (start + end) * (image_size - 1)]
+    return [c if 0 <= c <= image_size - 1 else None for c in coords]
+
+
+def dense_grad_image_from_numpy(grads, boxes, box_index, image_size):
+    # Scatters every sample of every box, zero gradients included.
+    grads_image = np.zeros(image_size)
+    for b in range(np.shape(boxes)[0]):
+        samples = [axis_samples(boxes[b, a], boxes[b, a + 3], image_size[a + 1], np.shape(grads)[a + 1])
+                   for a in range(3)]
+        for y, in_y in enumerate(samples[0]):
+            for x, in_x in enumerate(samples[1]):
+                for z, in_z in enumerate(samples[2]):
+                    if in_y is None or in_x is None or in_z is None:
+                        continue
+                    y0, x0, z0 = int(np.floor(in_y)), int(np.floor(in_x)), int(np.floor(in_z))
+                    y1, x1, z1 = int(np.ceil(in_y)), int(np.ceil(in_x)), int(np.ceil(in_z))
+                    ly, lx, lz = in_y - y0, in_x - x0, in_z - z0
+                    for yi, wy in [(y0, 1 - ly), (y1, ly)]:
+                        for xi, wx in [(x0, 1 - lx), (x1, lx)]:
+                            for zi, wz in [(z0, 1 - lz), (z1, lz)]:
+                                grads_image[box_index[b], yi, xi, zi] += wy * wx * wz * grads[b, y, x, z]
+    return grads_image
+
+
+np.random.seed(0)
+image_size = [2, 6, 7, 5, 2]
+boxes = np.array([[0.1, 0.2, 0.1, 0.8, 0.9, 0.7], [0, 0, 0, 1, 1, 1],
+                  [0.3, 0.1, 0.2, 0.6, 0.5, 0.9], [-0.2, 0.1, 0.1, 1.1, 0.8, 1.2]])
+box_index = np.array([0, 1, 1, 0])
+grads = np.random.rand(4, 4, 5, 3, 2)
+# Zero whole boxes, y slices and voxels so that every skip is taken.
+grads[1] = 0
+grads[2, 1:3] = 0
+grads[3, :, 2] = 0
+grads[0, 0, 0, 0] = 0
+
+#TestSparseMatchesDense
+control = dense_grad_image_from_numpy(grads, boxes, box_index, image_size)
+results = crop_and_resize_3d_grad_image(tf.constant(grads, tf.float32), tf.constant(boxes, tf.float32),
+                                        tf.constant(box_index, tf.int32), tf.constant(image_size, tf.int32),
+                                        T=tf.float32)
+if results.shape == control.shape and np.allclose(results.numpy(), control, atol=1e-5):
+    print('TestSparseMatchesDense is OK.')
+else:
+    print('TestSparseMatchesDense is not OK.')
+
+#TestAllZeroGrads
+results = crop_and_resize_3d_grad_image(tf.zeros(np.shape(grads), tf.float32), tf.constant(boxes, tf.float32),
+                                        tf.constant(box_index, tf.int32), tf.constant(image_size, tf.int32),
+                                        T=tf.float32)
+if results.shape == tuple(image_size) and not np.any(results.numpy()):
+    print('TestAllZeroGrads is OK.')
+else:
+    print('TestAllZeroGrads is not OK.')
+
+#TestFewerGradsThanBoxes
+try:
+    results = crop_and_resize_3d_grad_image(tf.constant(grads[:3], tf.float32), tf.constant(boxes, tf.float32),
+                                            tf.constant(box_index, tf.int32), tf.constant(image_size, tf.int32),
+                                            T=tf.float32)
+    print('TestFewerGradsThanBoxes is not OK.')
+except tf.errors.InvalidArgumentError as e:
+    if 'boxes and grads have incompatible shape' in str(e):
+        print('TestFewerGradsThanBoxes is OK.')
+    else:
+        print('TestFewerGradsThanBoxes is not OK.')
+
+#TestPaddedBoxes
+# Padding boxes with non-zero gradients follow the real ones, so that keeping
+# the first four boxes, or the first two boxes of each image, gives the
+# gradient of the real boxes alone.
+pad_boxes = np.concatenate([boxes, np.random.rand(3, 6)])
+pad_box_index = np.concatenate([box_index, [1, 0, 1]])
+pad_grads = np.concatenate([grads, np.random.rand(3, *np.shape(grads)[1:])])
+control = dense_grad_image_from_numpy(grads, boxes, box_index, image_size)
+ok = True
+for num_valid in [4, [2, 2]]:
+    results = crop_and_resize_3d_grad_image(tf.constant(pad_grads, tf.float32), tf.constant(pad_boxes, tf.float32),
+                                            tf.constant(pad_box_index, tf.int32), tf.constant(image_size, tf.int32),
+                                            T=tf.float32, num_valid=num_valid)
+    ok = ok and results.shape == control.shape and np.allclose(results.numpy(), control, atol=1e-5)
+if ok:
+    print('TestPaddedBoxes is OK.')
+else:
+    print('TestPaddedBoxes is not OK.')
\ No newline at end of file
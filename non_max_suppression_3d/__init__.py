@@ -1 +1 @@
-from non_max_suppression_3d.python.ops.non_max_suppression_3d_ops import non_max_suppression_3d
\ No newline at end of file
+from non_max_suppression_3d.python.ops.non_max_suppression_3d_ops import non_max_suppression_3d, non_max_suppression_3d_threshold_sweep
\ No newline at end of file
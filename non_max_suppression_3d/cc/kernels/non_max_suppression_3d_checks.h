@@ -0,0 +1,63 @@
+#ifndef NON_MAX_SUPPRESSION_3D_CC_KERNELS_NON_MAX_SUPPRESSION_3D_CHECKS_H_
+#define NON_MAX_SUPPRESSION_3D_CC_KERNELS_NON_MAX_SUPPRESSION_3D_CHECKS_H_
+
+#include <algorithm>
+
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor_shape.h"
+#include "tensorflow/core/lib/core/errors.h"
+#include "tensorflow/core/lib/core/status.h"
+
+// Input checks shared by the kernels of the NMS ops.
+
+namespace tensorflow {
+
+// Checks the boxes, scores, max_output_size and num_valid inputs of the NMS
+// ops. Sets *num_boxes to the number of boxes that may be selected, that is
+// all of them, or only the first num_valid ones if num_valid >= 0, and
+// *output_size to max_output_size.
+inline Status ParseAndCheckNonMaxSuppression3DInputs(
+    const Tensor& boxes, const Tensor& scores, const Tensor& max_output_size,
+    const Tensor& num_valid, int* num_boxes, int* output_size) {
+  // max_output_size: scalar
+  if (!TensorShapeUtils::IsScalar(max_output_size.shape())) {
+    return errors::InvalidArgument("max_output_size must be 0-D, got shape ",
+                                   max_output_size.shape().DebugString());
+  }
+  *output_size = max_output_size.scalar<int>()();
+  if (*output_size < 0) {
+    return errors::InvalidArgument("max_output_size must be >= 0");
+  }
+  // num_valid: scalar
+  if (!TensorShapeUtils::IsScalar(num_valid.shape())) {
+    return errors::InvalidArgument("num_valid must be 0-D, got shape ",
+                                   num_valid.shape().DebugString());
+  }
+  // The shape of 'boxes' is [num_boxes, 6]
+  if (boxes.dims() != 2) {
+    return errors::InvalidArgument("boxes must be 2-D",
+                                   boxes.shape().DebugString());
+  }
+  *num_boxes = boxes.dim_size(0);
+  if (boxes.dim_size(1) != 6) {
+    return errors::InvalidArgument("boxes must have 6 columns");
+  }
+  // The shape of 'scores' is [num_boxes]
+  if (scores.dims() != 1) {
+    return errors::InvalidArgument("scores must be 1-D",
+                                   scores.shape().DebugString());
+  }
+  if (scores.dim_size(0) != *num_boxes) {
+    return errors::InvalidArgument("scores has incompatible shape");
+  }
+  // Padded boxes past the first num_valid ones never become candidates.
+  const int num_valid_boxes = num_valid.scalar<int>()();
+  if (num_valid_boxes >= 0) {
+    *num_boxes = std::min(*num_boxes, num_valid_boxes);
+  }
+  return Status::OK();
+}
+
+}  // namespace tensorflow
+
+#endif  // NON_MAX_SUPPRESSION_3D_CC_KERNELS_NON_MAX_SUPPRESSION_3D_CHECKS_H_
@@ -0,0 +1,163 @@
+#ifndef NON_MAX_SUPPRESSION_3D_CC_KERNELS_NON_MAX_SUPPRESSION_3D_CPU_H_
+#define NON_MAX_SUPPRESSION_3D_CC_KERNELS_NON_MAX_SUPPRESSION_3D_CPU_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+// CPU greedy non-max-suppression shared with the other NMS ops. It only works
+// on raw buffers so that it does not depend on TensorFlow.
+
+namespace tensorflow {
+namespace functor {
+
+// Returns intersection-over-union overlap between the [y1, x1, z1, y2, x2, z2]
+// boxes i and j, whose corners may be given in any order.
+inline float IOU3D(const float* box_i, const float* box_j) {
+  const float ymin_i = std::min<float>(box_i[0], box_i[3]);
+  const float xmin_i = std::min<float>(box_i[1], box_i[4]);
+  const float zmin_i = std::min<float>(box_i[2], box_i[5]);
+  const float ymax_i = std::max<float>(box_i[0], box_i[3]);
+  const float xmax_i = std::max<float>(box_i[1], box_i[4]);
+  const float zmax_i = std::max<float>(box_i[2], box_i[5]);
+  const float ymin_j = std::min<float>(box_j[0], box_j[3]);
+  const float xmin_j = std::min<float>(box_j[1], box_j[4]);
+  const float zmin_j = std::min<float>(box_j[2], box_j[5]);
+  const float ymax_j = std::max<float>(box_j[0], box_j[3]);
+  const float xmax_j = std::max<float>(box_j[1], box_j[4]);
+  const float zmax_j = std::max<float>(box_j[2], box_j[5]);
+  const float area_i = (ymax_i - ymin_i) * (xmax_i - xmin_i) * (zmax_i - zmin_i);
+  const float area_j = (ymax_j - ymin_j) * (xmax_j - xmin_j) * (zmax_j - zmin_j);
+  if (area_i <= 0.0f || area_j <= 0.0f) {
+    return 0.0f;
+  }
+  const float intersection_ymin = std::max<float>(ymin_i, ymin_j);
+  const float intersection_xmin = std::max<float>(xmin_i, xmin_j);
+  const float intersection_zmin = std::max<float>(zmin_i, zmin_j);
+  const float intersection_ymax = std::min<float>(ymax_i, ymax_j);
+  const float intersection_xmax = std::min<float>(xmax_i, xmax_j);
+  const float intersection_zmax = std::min<float>(zmax_i, zmax_j);
+  const float intersection_area =
+      std::max<float>(intersection_ymax - intersection_ymin, 0.0f) *
+      std::max<float>(intersection_xmax - intersection_xmin, 0.0f) *
+      std::max<float>(intersection_zmax - intersection_zmin, 0.0f);
+  return intersection_area / (area_i + area_j - intersection_area);
+}
+
+// Returns the indices of the num_boxes boxes sorted by descending score, the
+// lower index first on ties. As in NonMaxSuppression3D, boxes scored NaN or
+// the lowest float are left out.
+inline std::vector<int> SortedNonMaxSuppression3DCandidates(const float* scores,
+                                                            int num_boxes) {
+  std::vector<int> candidates;
+  candidates.reserve(num_boxes);
+  for (int i = 0; i < num_boxes; ++i) {
+    if (scores[i] > std::numeric_limits<float>::lowest()) {
+      candidates.push_back(i);
+    }
+  }
+  std::stable_sort(candidates.begin(), candidates.end(),
+                   [scores](int i, int j) { return scores[i] > scores[j]; });
+  return candidates;
+}
+
+// Greedily selects up to max_output_size of the num_boxes [num_boxes, 6]
+// 'boxes' in descending order of 'scores', dropping boxes whose IoU with an
+// already selected box reaches iou_threshold. Gives the same selection as
+// NonMaxSuppression3D. If 'num_ious' is set, the number of IoUs computed is
+// added to it.
+inline void NonMaxSuppression3DGreedy(const float* boxes, const float* scores,
+                                      int num_boxes, float iou_threshold,
+                                      int max_output_size,
+                                      std::vector<int>* selected,
+                                      int64_t* num_ious = nullptr) {
+  selected->clear();
+  int64_t ious = 0;
+  const std::vector<int> candidates =
+      SortedNonMaxSuppression3DCandidates(scores, num_boxes);
+  for (int i = 0; i < static_cast<int>(candidates.size()) &&
+                  static_cast<int>(selected->size()) < max_output_size;
+       ++i) {
+    const int box_index = candidates[i];
+    // Overlapping boxes are likely to have similar scores, therefore we
+    // iterate through the previously selected boxes backwards.
+    bool should_select = true;
+    for (int j = static_cast<int>(selected->size()) - 1; j >= 0; --j) {
+      ++ious;
+      if (IOU3D(boxes + 6 * box_index, boxes + 6 * (*selected)[j]) >=
+          iou_threshold) {
+        should_select = false;
+        break;
+      }
+    }
+    if (should_select) {
+      selected->push_back(box_index);
+    }
+  }
+  if (num_ious != nullptr) {
+    *num_ious += ious;
+  }
+}
+
+// Runs NonMaxSuppression3DGreedy once per threshold of the num_thresholds
+// 'iou_thresholds', setting (*selected)[t] to the selection of threshold t.
+// The candidates are sorted once and all the thresholds go through them
+// together: the IoUs of a candidate with the boxes selected so far are cached
+// while it is being considered, so that an IoU needed by several thresholds
+// is computed once. If 'num_ious' is set, the number of IoUs computed is
+// added to it.
+inline void NonMaxSuppression3DThresholdSweep(
+    const float* boxes, const float* scores, int num_boxes,
+    const float* iou_thresholds, int num_thresholds, int max_output_size,
+    std::vector<std::vector<int>>* selected, int64_t* num_ious = nullptr) {
+  selected->assign(num_thresholds, std::vector<int>());
+  int64_t ious = 0;
+  const std::vector<int> candidates =
+      SortedNonMaxSuppression3DCandidates(scores, num_boxes);
+  // IoUs of the current candidate with the boxes, valid where iou_owner holds
+  // the index of the candidate.
+  std::vector<float> iou(num_boxes);
+  std::vector<int> iou_owner(num_boxes, -1);
+  int num_active = (max_output_size > 0) ? num_thresholds : 0;
+  for (int i = 0; i < static_cast<int>(candidates.size()) && num_active > 0;
+       ++i) {
+    const int box_index = candidates[i];
+    const float* box = boxes + 6 * box_index;
+    for (int t = 0; t < num_thresholds; ++t) {
+      std::vector<int>& selected_t = (*selected)[t];
+      if (static_cast<int>(selected_t.size()) >= max_output_size) {
+        continue;
+      }
+      // Overlapping boxes are likely to have similar scores, therefore we
+      // iterate through the previously selected boxes backwards.
+      bool should_select = true;
+      for (int j = static_cast<int>(selected_t.size()) - 1; j >= 0; --j) {
+        const int other = selected_t[j];
+        if (iou_owner[other] != i) {
+          iou[other] = IOU3D(box, boxes + 6 * other);
+          iou_owner[other] = i;
+          ++ious;
+        }
+        if (iou[other] >= iou_thresholds[t]) {
+          should_select = false;
+          break;
+        }
+      }
+      if (should_select) {
+        selected_t.push_back(box_index);
+        if (static_cast<int>(selected_t.size()) == max_output_size) {
+          --num_active;
+        }
+      }
+    }
+  }
+  if (num_ious != nullptr) {
+    *num_ious += ious;
+  }
+}
+
+}  // namespace functor
+}  // namespace tensorflow
+
+#endif  // NON_MAX_SUPPRESSION_3D_CC_KERNELS_NON_MAX_SUPPRESSION_3D_CPU_H_
@@ -1,4 +1,6 @@
 #include "non_max_suppression_3d.h"
+#include "non_max_suppression_3d_checks.h"
+#include "non_max_suppression_3d_cpu.h"
 
 #include <cmath>
 #include <functional>
@@ -21,16 +23,6 @@ namespace {
 
 typedef Eigen::ThreadPoolDevice CPUDevice;
 
-static inline void CheckScoreSizes(OpKernelContext* context, int num_boxes,
-                                   const Tensor& scores) {
-  // The shape of 'scores' is [num_boxes]
-  OP_REQUIRES(context, scores.dims() == 1,
-              errors::InvalidArgument("scores must be 1-D",
-                                      scores.shape().DebugString()));
-  OP_REQUIRES(context, scores.dim_size(0) == num_boxes,
-              errors::InvalidArgument("scores has incompatible shape"));
-}
-
 static inline void ParseAndCheckOverlapSizes(OpKernelContext* context,
                                              const Tensor& overlaps,
                                              int* num_boxes) {
@@ -48,17 +40,6 @@ static inline void ParseAndCheckOverlapSizes(OpKernelContext* context,
                                       overlaps.shape().DebugString()));
 }
 
-static inline void ParseAndCheckBoxSizes(OpKernelContext* context,
-                                         const Tensor& boxes, int* num_boxes) {
-  // The shape of 'boxes' is [num_boxes, 6]
-  OP_REQUIRES(context, boxes.dims() == 2,
-              errors::InvalidArgument("boxes must be 2-D",
-                                      boxes.shape().DebugString()));
-  *num_boxes = boxes.dim_size(0);
-  OP_REQUIRES(context, boxes.dim_size(1) == 6,
-              errors::InvalidArgument("boxes must have 6 columns"));
-}
-
 static inline void CheckCombinedNMSScoreSizes(OpKernelContext* context,
                                               int num_boxes,
                                               const Tensor& scores) {
@@ -87,51 +68,20 @@ static inline void ParseAndCheckCombinedNMSBoxSizes(OpKernelContext* context,
   OP_REQUIRES(context, boxes.dim_size(3) == 6,
               errors::InvalidArgument("boxes must have 6 columns"));
 }
-// Return intersection-over-union overlap between boxes i and j
-template <typename T>
-static inline T IOU(typename TTypes<T, 2>::ConstTensor boxes, int i, int j) {
-  const T ymin_i = std::min<T>(boxes(i, 0), boxes(i, 3));
-  const T xmin_i = std::min<T>(boxes(i, 1), boxes(i, 4));
-  const T zmin_i = std::min<T>(boxes(i, 2), boxes(i, 5));
-  const T ymax_i = std::max<T>(boxes(i, 0), boxes(i, 3));
-  const T xmax_i = std::max<T>(boxes(i, 1), boxes(i, 4));
-  const T zmax_i = std::max<T>(boxes(i, 2), boxes(i, 5));
-  const T ymin_j = std::min<T>(boxes(j, 0), boxes(j, 3));
-  const T xmin_j = std::min<T>(boxes(j, 1), boxes(j, 4));
-  const T zmin_j = std::min<T>(boxes(j, 2), boxes(j, 5));
-  const T ymax_j = std::max<T>(boxes(j, 0), boxes(j, 3));
-  const T xmax_j = std::max<T>(boxes(j, 1), boxes(j, 4));
-  const T zmax_j = std::max<T>(boxes(j, 2), boxes(j, 5));
-  const T area_i = (ymax_i - ymin_i) * (xmax_i - xmin_i) * (zmax_i - zmin_i);
-  const T area_j = (ymax_j - ymin_j) * (xmax_j - xmin_j) * (zmax_j - zmin_j);
-  if (area_i <= static_cast<T>(0) || area_j <= static_cast<T>(0)) {
-    return static_cast<T>(0.0);
-  }
-  const T intersection_ymin = std::max<T>(ymin_i, ymin_j);
-  const T intersection_xmin = std::max<T>(xmin_i, xmin_j);
-  const T intersection_zmin = std::max<T>(zmin_i, zmin_j);
-  const T intersection_ymax = std::min<T>(ymax_i, ymax_j);
-  const T intersection_xmax = std::min<T>(xmax_i, xmax_j);
-  const T intersection_zmax = std::min<T>(zmax_i, zmax_j);
-  const T intersection_area =
-      std::max<T>(intersection_ymax - intersection_ymin, static_cast<T>(0.0)) *
-      std::max<T>(intersection_xmax - intersection_xmin, static_cast<T>(0.0)) *
-      std::max<T>(intersection_zmax - intersection_zmin, static_cast<T>(0.0));
-  return intersection_area / (area_i + area_j - intersection_area);
-}
-
 template <typename T>
 static inline T Overlap(typename TTypes<T, 2>::ConstTensor overlaps, int i,
                         int j) {
   return overlaps(i, j);
 }
 
-template <typename T>
-static inline std::function<T(int, int)> CreateIOUSimilarityFn(
+// Returns the IoU of boxes i and j of the [num_boxes, 6] 'boxes', computed by
+// the IOU3D shared with the other NMS ops.
+static inline std::function<float(int, int)> CreateIOUSimilarityFn(
     const Tensor& boxes) {
-  typename TTypes<T, 2>::ConstTensor boxes_data = boxes.tensor<T, 2>();
-  return std::bind(&IOU<T>, boxes_data, std::placeholders::_1,
-                   std::placeholders::_2);
+  const float* boxes_data = boxes.flat<float>().data();
+  return [boxes_data](int i, int j) {
+    return functor::IOU3D(boxes_data + 6 * i, boxes_data + 6 * j);
+  };
 }
 
 template <typename T>
@@ -378,7 +328,8 @@ void BatchedNonMaxSuppressionOp(
         // in order to see if `next_candidate` should be suppressed.
         bool should_select = true;
         for (int j = selected.size() - 1; j >= 0; --j) {
-          iou = IOU<float>(boxes_data, next_candidate.box_index, selected[j]);
+          iou = functor::IOU3D(&boxes_data(next_candidate.box_index, 0),
+                               &boxes_data(selected[j], 0));
           if (iou > iou_threshold) {
             should_select = false;
             break;
@@ -506,26 +457,23 @@ class NonMaxSuppression3DOp : public OpKernel {
   }
 
   void Compute(OpKernelContext* context) override {
-    // boxes: [num_boxes, 4]
+    // boxes: [num_boxes, 6]
     const Tensor& boxes = context->input(0);
     // scores: [num_boxes]
     const Tensor& scores = context->input(1);
     // max_output_size: scalar
     const Tensor& max_output_size = context->input(2);
-    OP_REQUIRES(
-        context, TensorShapeUtils::IsScalar(max_output_size.shape()),
-        errors::InvalidArgument("max_output_size must be 0-D, got shape ",
-                                max_output_size.shape().DebugString()));
+    // num_valid: scalar
+    const Tensor& num_valid = context->input(3);
 
     OP_REQUIRES(context, iou_threshold_ >= 0 && iou_threshold_ <= 1,
                 errors::InvalidArgument("iou_threshold must be in [0, 1]"));
     int num_boxes = 0;
-    ParseAndCheckBoxSizes(context, boxes, &num_boxes);
-    CheckScoreSizes(context, num_boxes, scores);
-    if (!context->status().ok()) {
-      return;
-    }
-    auto similarity_fn = CreateIOUSimilarityFn<float>(boxes);
+    int output_size = 0;
+    OP_REQUIRES_OK(context, ParseAndCheckNonMaxSuppression3DInputs(
+                                boxes, scores, max_output_size, num_valid,
+                                &num_boxes, &output_size));
+    auto similarity_fn = CreateIOUSimilarityFn(boxes);
 
     const float score_threshold_val = std::numeric_limits<float>::lowest();
     const float dummy_soft_nms_sigma = static_cast<float>(0.0);
@@ -541,4 +489,69 @@ class NonMaxSuppression3DOp : public OpKernel {
 REGISTER_KERNEL_BUILDER(Name("NonMaxSuppression3D").Device(DEVICE_CPU),
                         NonMaxSuppression3DOp<CPUDevice>);
 
+// Runs NonMaxSuppression3D for every threshold of a vector of IoU thresholds
+// on the same boxes, sorting the candidates once and computing every IoU at
+// most once for all the thresholds.
+template <typename Device>
+class NonMaxSuppression3DThresholdSweepOp : public OpKernel {
+ public:
+  explicit NonMaxSuppression3DThresholdSweepOp(OpKernelConstruction* context)
+      : OpKernel(context) {}
+
+  void Compute(OpKernelContext* context) override {
+    // boxes: [num_boxes, 6]
+    const Tensor& boxes = context->input(0);
+    // scores: [num_boxes]
+    const Tensor& scores = context->input(1);
+    // max_output_size: scalar
+    const Tensor& max_output_size = context->input(2);
+    // iou_thresholds: [num_thresholds]
+    const Tensor& iou_thresholds = context->input(3);
+    // num_valid: scalar
+    const Tensor& num_valid = context->input(4);
+
+    OP_REQUIRES(
+        context, TensorShapeUtils::IsVector(iou_thresholds.shape()),
+        errors::InvalidArgument("iou_thresholds must be 1-D, got shape ",
+                                iou_thresholds.shape().DebugString()));
+    const int num_thresholds = iou_thresholds.dim_size(0);
+    const float* thresholds = iou_thresholds.flat<float>().data();
+    for (int t = 0; t < num_thresholds; ++t) {
+      OP_REQUIRES(context, thresholds[t] >= 0 && thresholds[t] <= 1,
+                  errors::InvalidArgument("iou_thresholds must be in [0, 1]"));
+    }
+    int num_boxes = 0;
+    int output_size = 0;
+    OP_REQUIRES_OK(context, ParseAndCheckNonMaxSuppression3DInputs(
+                                boxes, scores, max_output_size, num_valid,
+                                &num_boxes, &output_size));
+
+    std::vector<std::vector<int>> selected;
+    functor::NonMaxSuppression3DThresholdSweep(
+        boxes.flat<float>().data(), scores.flat<float>().data(), num_boxes,
+        thresholds, num_thresholds, output_size, &selected);
+
+    Tensor* output_indices = nullptr;
+    OP_REQUIRES_OK(context, context->allocate_output(
+                                0, TensorShape({num_thresholds, output_size}),
+                                &output_indices));
+    Tensor* output_num_selected = nullptr;
+    OP_REQUIRES_OK(context, context->allocate_output(
+                                1, TensorShape({num_thresholds}),
+                                &output_num_selected));
+    auto indices = output_indices->matrix<int>();
+    auto num_selected = output_num_selected->vec<int>();
+    indices.setConstant(-1);
+    for (int t = 0; t < num_thresholds; ++t) {
+      std::copy(selected[t].begin(), selected[t].end(),
+                indices.data() + t * output_size);
+      num_selected(t) = static_cast<int>(selected[t].size());
+    }
+  }
+};
+
+REGISTER_KERNEL_BUILDER(
+    Name("NonMaxSuppression3DThresholdSweep").Device(DEVICE_CPU),
+    NonMaxSuppression3DThresholdSweepOp<CPUDevice>);
+
 }  // namespace tensorflow
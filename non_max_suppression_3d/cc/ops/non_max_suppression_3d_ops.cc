@@ -7,6 +7,7 @@ REGISTER_OP("NonMaxSuppression3D")
     .Input("boxes: float")
     .Input("scores: float")
     .Input("max_output_size: int32")
+    .Input("num_valid: int32")
     .Output("selected_indices: int32")
     .Attr("iou_threshold: float = 0.5")
     .SetShapeFn([](::tensorflow::shape_inference::InferenceContext* c) {
@@ -17,6 +18,8 @@ REGISTER_OP("NonMaxSuppression3D")
       TF_RETURN_IF_ERROR(c->WithRank(c->input(1), 1, &scores));
       ::tensorflow::shape_inference::ShapeHandle max_output_size;
       TF_RETURN_IF_ERROR(c->WithRank(c->input(2), 0, &max_output_size));
+      ::tensorflow::shape_inference::ShapeHandle num_valid;
+      TF_RETURN_IF_ERROR(c->WithRank(c->input(3), 0, &num_valid));
       // The boxes is a 2-D float Tensor of shape [num_boxes, 4].
       ::tensorflow::shape_inference::DimensionHandle unused;
       // The boxes[0] and scores[0] are both num_boxes.
@@ -29,4 +32,40 @@ REGISTER_OP("NonMaxSuppression3D")
       return Status::OK();
     });
 
+REGISTER_OP("NonMaxSuppression3DThresholdSweep")
+    .Input("boxes: float")
+    .Input("scores: float")
+    .Input("max_output_size: int32")
+    .Input("iou_thresholds: float")
+    .Input("num_valid: int32")
+    .Output("selected_indices: int32")
+    .Output("num_selected: int32")
+    .SetShapeFn([](::tensorflow::shape_inference::InferenceContext* c) {
+      // Get inputs and validate ranks.
+      ::tensorflow::shape_inference::ShapeHandle boxes;
+      TF_RETURN_IF_ERROR(c->WithRank(c->input(0), 2, &boxes));
+      ::tensorflow::shape_inference::ShapeHandle scores;
+      TF_RETURN_IF_ERROR(c->WithRank(c->input(1), 1, &scores));
+      ::tensorflow::shape_inference::ShapeHandle max_output_size;
+      TF_RETURN_IF_ERROR(c->WithRank(c->input(2), 0, &max_output_size));
+      ::tensorflow::shape_inference::ShapeHandle iou_thresholds;
+      TF_RETURN_IF_ERROR(c->WithRank(c->input(3), 1, &iou_thresholds));
+      ::tensorflow::shape_inference::ShapeHandle num_valid;
+      TF_RETURN_IF_ERROR(c->WithRank(c->input(4), 0, &num_valid));
+      ::tensorflow::shape_inference::DimensionHandle unused;
+      // The boxes[0] and scores[0] are both num_boxes.
+      TF_RETURN_IF_ERROR(
+          c->Merge(c->Dim(boxes, 0), c->Dim(scores, 0), &unused));
+      // The boxes[1] is 6.
+      TF_RETURN_IF_ERROR(c->WithValue(c->Dim(boxes, 1), 6, &unused));
+
+      // One row of selected indices, padded with -1, per threshold.
+      ::tensorflow::shape_inference::DimensionHandle output_size;
+      TF_RETURN_IF_ERROR(c->MakeDimForScalarInput(2, &output_size));
+      c->set_output(0,
+                    c->Matrix(c->Dim(iou_thresholds, 0), output_size));
+      c->set_output(1, c->Vector(c->Dim(iou_thresholds, 0)));
+      return Status::OK();
+    });
+
 }
\ No newline at end of file
@@ -5,4 +5,28 @@ from tensorflow.python.platform import resource_loader
 non_max_suppression_3d_ops = load_library.load_op_library(
     resource_loader.get_path_to_datafile('_non_max_suppression_3d_ops.so'))
 
-non_max_suppression_3d = non_max_suppression_3d_ops.non_max_suppression3d
+
+def non_max_suppression_3d(boxes, scores, max_output_size, iou_threshold=0.5,
+                           num_valid=-1, name=None):
+    """Greedily selects boxes in descending order of score.
+
+    Only the first `num_valid` boxes are considered, the rest being padding.
+    A negative `num_valid` considers every box.
+    """
+    return non_max_suppression_3d_ops.non_max_suppression3d(
+        boxes, scores, max_output_size, num_valid,
+        iou_threshold=iou_threshold, name=name)
+
+
+def non_max_suppression_3d_threshold_sweep(boxes, scores, max_output_size,
+                                           iou_thresholds, num_valid=-1,
+                                           name=None):
+    """Runs `non_max_suppression_3d` for each of `iou_thresholds` at once.
+
+    Returns `selected_indices`, of shape [num_thresholds, max_output_size],
+    whose row t holds the selection for `iou_thresholds[t]` padded with -1,
+    and `num_selected`, the number of boxes selected for each threshold.
+    Every IoU is computed at most once for all the thresholds.
+    """
+    return non_max_suppression_3d_ops.non_max_suppression3d_threshold_sweep(
+        boxes, scores, max_output_size, iou_thresholds, num_valid, name=name)
@@ -2,7 +2,7 @@ import os
 import numpy as np
 import tensorflow as tf
 
-from non_max_suppression_3d import non_max_suppression_3d
+from non_max_suppression_3d import non_max_suppression_3d, non_max_suppression_3d_threshold_sweep
 
 # Comment the following line to debug TF or libcuda issues
 os.environ['TF_CPP_MIN_LOG_LEVEL'] = '3'
@@ -106,4 +106,59 @@ scores10 = tf.dtypes.cast(scores10, tf.float32)
 max_output_size10 = 30
 results10 = non_max_suppression_3d(boxes=boxes10, scores=scores10, max_output_size=max_output_size10)
 if (results10.numpy() == np.array([])).all:
-    print('TestEmptyInput is OK.')
\ No newline at end of file
+    print('TestEmptyInput is OK.')
+
+#TestSelectFromPaddedBoxes
+boxes11 = np.concatenate([boxes1.numpy(), np.zeros((4,6))])
+scores11 = np.concatenate([scores1.numpy(), np.ones(4)])
+boxes11 = tf.dtypes.cast(boxes11, tf.float32)
+scores11 = tf.dtypes.cast(scores11, tf.float32)
+max_output_size11 = 30
+results11 = non_max_suppression_3d(boxes=boxes11, scores=scores11, max_output_size=max_output_size11, num_valid=6)
+if (results11.numpy() == np.array([3, 0, 5])).all():
+    print('TestSelectFromPaddedBoxes is OK.')
+
+
+#TestThresholdSweep
+np.random.seed(0)
+corners12 = np.random.uniform(0, 10, (64, 3))
+boxes12 = np.concatenate([corners12, corners12 + np.random.uniform(0.5, 3, (64, 3))], axis=1)
+boxes12 = tf.dtypes.cast(boxes12, tf.float32)
+scores12 = tf.dtypes.cast(np.random.uniform(0, 1, 64), tf.float32)
+max_output_size12 = 20
+iou_thresholds12 = np.array([0.7, 0.0, 0.3, 0.5, 0.1, 1.0], dtype=np.float32)
+results12, num_selected12 = non_max_suppression_3d_threshold_sweep(boxes=boxes12, scores=scores12, max_output_size=max_output_size12, iou_thresholds=iou_thresholds12, num_valid=60)
+sweep_ok = results12.shape == (6, max_output_size12)
+for t, threshold in enumerate(iou_thresholds12):
+    expected = non_max_suppression_3d(boxes=boxes12, scores=scores12, max_output_size=max_output_size12, iou_threshold=threshold, num_valid=60).numpy()
+    row = results12.numpy()[t]
+    sweep_ok = sweep_ok and num_selected12.numpy()[t] == len(expected)
+    sweep_ok = sweep_ok and (row[:len(expected)] == expected).all() and (row[len(expected):] == -1).all()
+if sweep_ok:
+    print('TestThresholdSweep is OK.')
+else:
+    print('TestThresholdSweep is not OK.')
+
+#TestThresholdSweepEmptyThresholds
+results13, num_selected13 = non_max_suppression_3d_threshold_sweep(boxes=boxes12, scores=scores12, max_output_size=max_output_size12, iou_thresholds=np.array([], dtype=np.float32))
+if results13.shape == (0, max_output_size12) and num_selected13.shape == (0,):
+    print('TestThresholdSweepEmptyThresholds is OK.')
+else:
+    print('TestThresholdSweepEmptyThresholds is not OK.')
+
+#TestThresholdSweepNoValidBox
+results14, num_selected14 = non_max_suppression_3d_threshold_sweep(boxes=boxes12, scores=scores12, max_output_size=max_output_size12, iou_thresholds=iou_thresholds12, num_valid=0)
+if results14.shape == (6, max_output_size12) and (results14.numpy() == -1).all() and (num_selected14.numpy() == 0).all():
+    print('TestThresholdSweepNoValidBox is OK.')
+else:
+    print('TestThresholdSweepNoValidBox is not OK.')
+
+#TestThresholdSweepInvalidThreshold
+try:
+    non_max_suppression_3d_threshold_sweep(boxes=boxes12, scores=scores12, max_output_size=max_output_size12, iou_thresholds=np.array([0.5, 1.2], dtype=np.float32))
+    print('TestThresholdSweepInvalidThreshold is not OK.')
+except tf.errors.InvalidArgumentError as e:
+    if 'iou_thresholds must be in [0, 1]' in str(e):
+        print('TestThresholdSweepInvalidThreshold is OK.')
+    else:
+        print('TestThresholdSweepInvalidThreshold is not OK.')
\ No newline at end of file
@@ -0,0 +1,493 @@
+// Crops a list of boxes out of raw or NIfTI-1 volumes, the same way as
+// CropAndResize3D, and writes the crops into a memory-mappable dataset.
+//
+//   roi_extract_3d --crop_size=h,w,d [--method=trilinear|nearest]
+//       [--extrapolation_value=v] [--num_threads=n]
+//       [--shape=H,W,D[,C] --dtype=float32] boxes.txt output
+//
+// Every non-empty line of boxes.txt not starting with '#' holds a volume path
+// followed by a box "y1 x1 z1 y2 x2 z2" in normalized coordinates. Paths
+// ending in .nii are read as NIfTI-1 volumes, the others as raw volumes of
+// the given --shape and --dtype. Each volume is read once, and volumes are
+// cropped in parallel.
+//
+// output.bin starts with a kHeaderSize bytes header (see CropDatasetHeader)
+// followed by the float32 [num_crops, h, w, d, C] crops, row-major, in the
+// order of boxes.txt. output.idx lists, one line per crop, its index, its byte
+// offset in output.bin, its volume and its box.
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "crop_and_resize_3d/cc/kernels/crop_and_resize_3d.h"
+#include "roi_extract_3d/cc/tools/volume_io.h"
+
+namespace roi_extract_3d {
+namespace {
+
+const int64_t kHeaderSize = 4096;
+
+// Header of output.bin, padded with zeros up to kHeaderSize bytes so that the
+// crops are page aligned. The fields are stored in this order, without
+// padding, little-endian (see EncodeHeader).
+struct CropDatasetHeader {
+  char magic[8];  // "ROICROP\0"
+  uint32_t version;
+  uint32_t header_size;
+  uint64_t num_crops;
+  uint32_t crop_height;
+  uint32_t crop_width;
+  uint32_t crop_depth;
+  uint32_t channels;
+};
+
+// Stores the 'size' low bytes of 'value' at 'out', little-endian.
+void PutLittleEndian(uint64_t value, int size, char* out) {
+  for (int i = 0; i < size; ++i) {
+    out[i] = static_cast<char>((value >> (8 * i)) & 0xff);
+  }
+}
+
+// Serializes 'header' field by field, so that the layout of output.bin does
+// not depend on the struct layout nor on the byte order of the host.
+void EncodeHeader(const CropDatasetHeader& header, char* out) {
+  std::memcpy(out, header.magic, 8);
+  PutLittleEndian(header.version, 4, out + 8);
+  PutLittleEndian(header.header_size, 4, out + 12);
+  PutLittleEndian(header.num_crops, 8, out + 16);
+  PutLittleEndian(header.crop_height, 4, out + 24);
+  PutLittleEndian(header.crop_width, 4, out + 28);
+  PutLittleEndian(header.crop_depth, 4, out + 32);
+  PutLittleEndian(header.channels, 4, out + 36);
+}
+
+struct Options {
+  int crop_height = 0;
+  int crop_width = 0;
+  int crop_depth = 0;
+  bool trilinear = true;
+  float extrapolation_value = 0;
+  int num_threads = 0;
+  // Shape and voxel type of raw volumes.
+  std::vector<int> shape;
+  VoxelType dtype = VoxelType::kFloat32;
+  std::string boxes_path;
+  std::string output_prefix;
+};
+
+struct Box {
+  int64_t index;
+  float coords[6];
+};
+
+// The boxes of one volume, with their positions in the dataset.
+struct VolumeBoxes {
+  std::string path;
+  std::vector<Box> boxes;
+};
+
+void Usage() {
+  std::fprintf(stderr,
+               "usage: roi_extract_3d --crop_size=h,w,d "
+               "[--method=trilinear|nearest] [--extrapolation_value=v] "
+               "[--num_threads=n] [--shape=H,W,D[,C] --dtype=float32] "
+               "boxes.txt output\n");
+}
+
+bool ParseInts(const std::string& value, std::vector<int>* ints) {
+  ints->clear();
+  std::stringstream stream(value);
+  std::string item;
+  while (std::getline(stream, item, ',')) {
+    char* end = nullptr;
+    const long parsed = std::strtol(item.c_str(), &end, 10);
+    if (item.empty() || *end != '\0' || parsed <= 0 || parsed > INT32_MAX) {
+      return false;
+    }
+    ints->push_back(parsed);
+  }
+  return true;
+}
+
+bool ParseOptions(int argc, char** argv, Options* options) {
+  std::vector<std::string> positional;
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if (arg.compare(0, 2, "--") != 0) {
+      positional.push_back(arg);
+      continue;
+    }
+    const size_t equal = arg.find('=');
+    if (equal == std::string::npos) {
+      std::fprintf(stderr, "missing value for %s\n", arg.c_str());
+      return false;
+    }
+    const std::string key = arg.substr(2, equal - 2);
+    const std::string value = arg.substr(equal + 1);
+    std::vector<int> ints;
+    if (key == "crop_size") {
+      if (!ParseInts(value, &ints) || ints.size() != 3) {
+        std::fprintf(stderr, "crop_size must be three positive integers\n");
+        return false;
+      }
+      options->crop_height = ints[0];
+      options->crop_width = ints[1];
+      options->crop_depth = ints[2];
+    } else if (key == "method") {
+      if (value != "trilinear" && value != "nearest") {
+        std::fprintf(stderr, "method must be 'trilinear' or 'nearest'\n");
+        return false;
+      }
+      options->trilinear = value == "trilinear";
+    } else if (key == "extrapolation_value") {
+      char* end = nullptr;
+      errno = 0;
+      options->extrapolation_value = std::strtof(value.c_str(), &end);
+      if (value.empty() || *end != '\0' || errno == ERANGE) {
+        std::fprintf(stderr, "extrapolation_value must be a float\n");
+        return false;
+      }
+    } else if (key == "num_threads") {
+      if (!ParseInts(value, &ints) || ints.size() != 1) {
+        std::fprintf(stderr, "num_threads must be a positive integer\n");
+        return false;
+      }
+      options->num_threads = ints[0];
+    } else if (key == "shape") {
+      if (!ParseInts(value, &options->shape) ||
+          (options->shape.size() != 3 && options->shape.size() != 4)) {
+        std::fprintf(stderr, "shape must be three or four positive integers\n");
+        return false;
+      }
+    } else if (key == "dtype") {
+      if (!ParseVoxelType(value, &options->dtype)) {
+        std::fprintf(stderr, "unsupported dtype %s\n", value.c_str());
+        return false;
+      }
+    } else {
+      std::fprintf(stderr, "unknown flag --%s\n", key.c_str());
+      return false;
+    }
+  }
+  if (positional.size() != 2 || options->crop_height == 0) {
+    return false;
+  }
+  options->boxes_path = positional[0];
+  options->output_prefix = positional[1];
+  if (options->num_threads == 0) {
+    options->num_threads =
+        std::max<int>(std::thread::hardware_concurrency(), 1);
+  }
+  return true;
+}
+
+// Reads the box list, grouping the boxes by volume in order of first use.
+bool ReadBoxes(const std::string& path, std::vector<VolumeBoxes>* volumes,
+               std::vector<std::string>* index_lines, std::string* error) {
+  std::ifstream file(path);
+  if (!file) {
+    *error = "cannot open " + path;
+    return false;
+  }
+  std::map<std::string, size_t> volume_ids;
+  std::string line;
+  int line_number = 0;
+  while (std::getline(file, line)) {
+    ++line_number;
+    std::stringstream stream(line);
+    std::string volume_path;
+    if (!(stream >> volume_path) || volume_path[0] == '#') {
+      continue;
+    }
+    Box box;
+    box.index = index_lines->size();
+    for (int i = 0; i < 6; ++i) {
+      if (!(stream >> box.coords[i])) {
+        *error = path + ":" + std::to_string(line_number) +
+                 ": expected a volume path followed by six box coordinates";
+        return false;
+      }
+    }
+    auto it = volume_ids.find(volume_path);
+    if (it == volume_ids.end()) {
+      it = volume_ids.emplace(volume_path, volumes->size()).first;
+      volumes->emplace_back();
+      volumes->back().path = volume_path;
+    }
+    (*volumes)[it->second].boxes.push_back(box);
+
+    std::ostringstream index_line;
+    index_line.precision(9);
+    index_line << volume_path;
+    for (int i = 0; i < 6; ++i) {
+      index_line << '\t' << box.coords[i];
+    }
+    index_lines->push_back(index_line.str());
+  }
+  return true;
+}
+
+bool EndsWith(const std::string& value, const std::string& suffix) {
+  return value.size() >= suffix.size() &&
+         value.compare(value.size() - suffix.size(), suffix.size(), suffix) ==
+             0;
+}
+
+bool ReadVolume(const std::string& path, const Options& options,
+                Volume* volume, std::string* error) {
+  if (EndsWith(path, ".nii")) {
+    return ReadNiftiVolume(path, volume, error);
+  }
+  if (EndsWith(path, ".nii.gz")) {
+    *error = path + ": compressed NIfTI volumes are not supported";
+    return false;
+  }
+  if (options.shape.empty()) {
+    *error = path + ": raw volumes need --shape";
+    return false;
+  }
+  const int channels = (options.shape.size() == 4) ? options.shape[3] : 1;
+  return ReadRawVolume(path, options.shape[0], options.shape[1],
+                       options.shape[2], channels, options.dtype, volume,
+                       error);
+}
+
+// Returns in 'channels' the channel count of the volume 'path' without
+// reading its voxels: from the NIfTI-1 header, or else from --shape.
+bool ReadVolumeChannels(const std::string& path, const Options& options,
+                        int* channels, std::string* error) {
+  if (EndsWith(path, ".nii")) {
+    return ReadNiftiChannels(path, channels, error);
+  }
+  if (EndsWith(path, ".nii.gz")) {
+    *error = path + ": compressed NIfTI volumes are not supported";
+    return false;
+  }
+  if (options.shape.empty()) {
+    *error = path + ": raw volumes need --shape";
+    return false;
+  }
+  *channels = (options.shape.size() == 4) ? options.shape[3] : 1;
+  return true;
+}
+
+bool WriteAt(int fd, const void* data, int64_t size, int64_t offset) {
+  const char* bytes = static_cast<const char*>(data);
+  while (size > 0) {
+    const ssize_t written = pwrite(fd, bytes, size, offset);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    bytes += written;
+    size -= written;
+    offset += written;
+  }
+  return true;
+}
+
+// Shared state of the threads cropping the volumes.
+struct Extraction {
+  const Options* options;
+  const std::vector<VolumeBoxes>* volumes;
+  int fd;
+  std::atomic<size_t> next_volume{0};
+  // Channel count of the dataset, from the header of the first volume.
+  std::mutex mu;
+  int channels = 0;
+  bool failed = false;
+  std::string error;
+
+  void Fail(const std::string& message) {
+    std::lock_guard<std::mutex> l(mu);
+    if (!failed) {
+      failed = true;
+      error = message;
+    }
+  }
+  bool Failed() {
+    std::lock_guard<std::mutex> l(mu);
+    return failed;
+  }
+};
+
+void ExtractVolumes(Extraction* extraction) {
+  const Options& options = *extraction->options;
+  const int64_t crop_voxels = static_cast<int64_t>(options.crop_height) *
+                              options.crop_width * options.crop_depth;
+  Volume volume;
+  std::vector<float> crop;
+  for (;;) {
+    const size_t v = extraction->next_volume++;
+    if (v >= extraction->volumes->size() || extraction->Failed()) {
+      return;
+    }
+    const VolumeBoxes& volume_boxes = (*extraction->volumes)[v];
+    std::string error;
+    if (!ReadVolume(volume_boxes.path, options, &volume, &error)) {
+      extraction->Fail(error);
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> l(extraction->mu);
+      if (extraction->channels != volume.channels) {
+        extraction->failed = true;
+        extraction->error =
+            volume_boxes.path + " has " + std::to_string(volume.channels) +
+            " channels, expected " + std::to_string(extraction->channels);
+        return;
+      }
+    }
+    const int64_t crop_size = crop_voxels * volume.channels;
+    crop.resize(crop_size);
+    for (const Box& box : volume_boxes.boxes) {
+      tensorflow::functor::CropAndResize3DBox(
+          volume.data.data(), volume.height, volume.width, volume.depth,
+          volume.channels, box.coords, options.crop_height, options.crop_width,
+          options.crop_depth, options.trilinear, options.extrapolation_value,
+          crop.data());
+      // Crops are stored little-endian, like the header.
+      if (HostIsBigEndian()) {
+        for (float& value : crop) {
+          internal::SwapBytes(reinterpret_cast<char*>(&value), sizeof(value));
+        }
+      }
+      const int64_t crop_bytes = crop_size * sizeof(float);
+      if (!WriteAt(extraction->fd, crop.data(), crop_bytes,
+                   kHeaderSize + box.index * crop_bytes)) {
+        extraction->Fail("cannot write " + options.output_prefix + ".bin: " +
+                         std::strerror(errno));
+        return;
+      }
+    }
+  }
+}
+
+int Run(const Options& options) {
+  std::vector<VolumeBoxes> volumes;
+  std::vector<std::string> index_lines;
+  std::string error;
+  if (!ReadBoxes(options.boxes_path, &volumes, &index_lines, &error)) {
+    std::fprintf(stderr, "%s\n", error.c_str());
+    return 1;
+  }
+  if (volumes.empty()) {
+    std::fprintf(stderr, "%s holds no box\n", options.boxes_path.c_str());
+    return 1;
+  }
+
+  // The channel count, hence the size of the crops, comes from the header of
+  // the first volume, whose voxels are only read by the worker cropping it.
+  // The other volumes must match it.
+  int channels = 0;
+  if (!ReadVolumeChannels(volumes[0].path, options, &channels, &error)) {
+    std::fprintf(stderr, "%s\n", error.c_str());
+    return 1;
+  }
+
+  // Partially written outputs are removed on failure, so that a dataset on
+  // disk is always complete.
+  const std::string bin_path = options.output_prefix + ".bin";
+  const std::string idx_path = options.output_prefix + ".idx";
+  const int fd = open(bin_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    std::fprintf(stderr, "cannot open %s: %s\n", bin_path.c_str(),
+                 std::strerror(errno));
+    return 1;
+  }
+  const int64_t crop_bytes = static_cast<int64_t>(options.crop_height) *
+                             options.crop_width * options.crop_depth *
+                             channels * sizeof(float);
+  std::vector<char> header_bytes(kHeaderSize, 0);
+  CropDatasetHeader header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, "ROICROP", 8);
+  header.version = 1;
+  header.header_size = kHeaderSize;
+  header.num_crops = index_lines.size();
+  header.crop_height = options.crop_height;
+  header.crop_width = options.crop_width;
+  header.crop_depth = options.crop_depth;
+  header.channels = channels;
+  EncodeHeader(header, header_bytes.data());
+  if (!WriteAt(fd, header_bytes.data(), kHeaderSize, 0) ||
+      ftruncate(fd, kHeaderSize + header.num_crops * crop_bytes) != 0) {
+    std::fprintf(stderr, "cannot write %s: %s\n", bin_path.c_str(),
+                 std::strerror(errno));
+    close(fd);
+    unlink(bin_path.c_str());
+    return 1;
+  }
+
+  Extraction extraction;
+  extraction.options = &options;
+  extraction.volumes = &volumes;
+  extraction.fd = fd;
+  extraction.channels = channels;
+  std::vector<std::thread> threads;
+  const int num_threads =
+      std::min<size_t>(options.num_threads, volumes.size());
+  for (int i = 0; i < num_threads; ++i) {
+    threads.emplace_back(ExtractVolumes, &extraction);
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  if (close(fd) != 0 && !extraction.failed) {
+    extraction.failed = true;
+    extraction.error = "cannot write " + bin_path + ": " + std::strerror(errno);
+  }
+  if (extraction.failed) {
+    std::fprintf(stderr, "%s\n", extraction.error.c_str());
+    unlink(bin_path.c_str());
+    return 1;
+  }
+
+  std::ofstream idx(idx_path);
+  idx << "# index\toffset\tvolume\ty1\tx1\tz1\ty2\tx2\tz2\n";
+  for (size_t i = 0; i < index_lines.size(); ++i) {
+    idx << i << '\t' << kHeaderSize + i * crop_bytes << '\t' << index_lines[i]
+        << '\n';
+  }
+  idx.close();
+  if (!idx) {
+    std::fprintf(stderr, "cannot write %s\n", idx_path.c_str());
+    unlink(idx_path.c_str());
+    unlink(bin_path.c_str());
+    return 1;
+  }
+  std::printf("wrote %zu crops of %d x %d x %d x %d from %zu volumes to %s\n",
+              index_lines.size(), options.crop_height, options.crop_width,
+              options.crop_depth, channels, volumes.size(), bin_path.c_str());
+  return 0;
+}
+
+}  // namespace
+}  // namespace roi_extract_3d
+
+int main(int argc, char** argv) {
+  roi_extract_3d::Options options;
+  if (!roi_extract_3d::ParseOptions(argc, argv, &options)) {
+    roi_extract_3d::Usage();
+    return 2;
+  }
+  return roi_extract_3d::Run(options);
+}
@@ -0,0 +1,333 @@
+#ifndef ROI_EXTRACT_3D_CC_TOOLS_VOLUME_IO_H_
+#define ROI_EXTRACT_3D_CC_TOOLS_VOLUME_IO_H_
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Reading of the volumes cropped by roi_extract_3d. Volumes are returned as
+// float [height, width, depth, channels] row-major buffers, the layout of one
+// image of CropAndResize3D.
+
+namespace roi_extract_3d {
+
+struct Volume {
+  int height = 0;
+  int width = 0;
+  int depth = 0;
+  int channels = 0;
+  std::vector<float> data;
+};
+
+// Element types of raw volumes and of NIfTI-1 datatype codes.
+enum class VoxelType { kUInt8, kInt8, kInt16, kUInt16, kInt32, kUInt32,
+                       kFloat32, kFloat64 };
+
+inline bool ParseVoxelType(const std::string& name, VoxelType* type) {
+  static const struct { const char* name; VoxelType type; } kTypes[] = {
+      {"uint8", VoxelType::kUInt8},     {"int8", VoxelType::kInt8},
+      {"int16", VoxelType::kInt16},     {"uint16", VoxelType::kUInt16},
+      {"int32", VoxelType::kInt32},     {"uint32", VoxelType::kUInt32},
+      {"float32", VoxelType::kFloat32}, {"float64", VoxelType::kFloat64},
+  };
+  for (const auto& t : kTypes) {
+    if (name == t.name) {
+      *type = t.type;
+      return true;
+    }
+  }
+  return false;
+}
+
+inline int VoxelSize(VoxelType type) {
+  switch (type) {
+    case VoxelType::kUInt8:
+    case VoxelType::kInt8:
+      return 1;
+    case VoxelType::kInt16:
+    case VoxelType::kUInt16:
+      return 2;
+    case VoxelType::kInt32:
+    case VoxelType::kUInt32:
+    case VoxelType::kFloat32:
+      return 4;
+    case VoxelType::kFloat64:
+      return 8;
+  }
+  return 0;
+}
+
+// Whether the host stores multi-byte values big-endian first, in which case
+// little-endian files are byte swapped on load and store.
+inline bool HostIsBigEndian() {
+  const uint16_t one = 1;
+  unsigned char first_byte;
+  std::memcpy(&first_byte, &one, 1);
+  return first_byte == 0;
+}
+
+namespace internal {
+
+inline void SwapBytes(char* value, int size) {
+  for (int i = 0; i < size / 2; ++i) {
+    std::swap(value[i], value[size - 1 - i]);
+  }
+}
+
+template <typename T>
+inline T Load(const char* in, bool swap) {
+  char bytes[sizeof(T)];
+  std::memcpy(bytes, in, sizeof(T));
+  if (swap) {
+    SwapBytes(bytes, sizeof(T));
+  }
+  T value;
+  std::memcpy(&value, bytes, sizeof(T));
+  return value;
+}
+
+// Converts voxel i of 'in' to float.
+inline float LoadVoxel(const char* in, int64_t i, VoxelType type, bool swap) {
+  switch (type) {
+    case VoxelType::kUInt8:
+      return Load<uint8_t>(in + i, swap);
+    case VoxelType::kInt8:
+      return Load<int8_t>(in + i, swap);
+    case VoxelType::kInt16:
+      return Load<int16_t>(in + 2 * i, swap);
+    case VoxelType::kUInt16:
+      return Load<uint16_t>(in + 2 * i, swap);
+    case VoxelType::kInt32:
+      return Load<int32_t>(in + 4 * i, swap);
+    case VoxelType::kUInt32:
+      return Load<uint32_t>(in + 4 * i, swap);
+    case VoxelType::kFloat32:
+      return Load<float>(in + 4 * i, swap);
+    case VoxelType::kFloat64:
+      return Load<double>(in + 8 * i, swap);
+  }
+  return 0;
+}
+
+inline bool ReadFile(const std::string& path, std::vector<char>* contents,
+                     std::string* error) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    *error = "cannot open " + path;
+    return false;
+  }
+  // Files without a size, such as pipes, fail to seek: they are read in
+  // chunks up to their end instead.
+  file.seekg(0, std::ios::end);
+  const std::streamoff size = file.tellg();
+  if (size < 0) {
+    file.clear();
+    contents->clear();
+    char chunk[1 << 16];
+    while (file.read(chunk, sizeof(chunk)) || file.gcount() > 0) {
+      contents->insert(contents->end(), chunk, chunk + file.gcount());
+    }
+    if (file.bad()) {
+      *error = "cannot read " + path;
+      return false;
+    }
+    return true;
+  }
+  file.seekg(0);
+  contents->resize(static_cast<size_t>(size));
+  if (!file.read(contents->data(), contents->size())) {
+    *error = "cannot read " + path;
+    return false;
+  }
+  return true;
+}
+
+}  // namespace internal
+
+// Reads a headerless volume of 'type' voxels stored row-major as
+// [height, width, depth, channels], in little-endian byte order.
+inline bool ReadRawVolume(const std::string& path, int height, int width,
+                          int depth, int channels, VoxelType type,
+                          Volume* volume, std::string* error) {
+  std::vector<char> contents;
+  if (!internal::ReadFile(path, &contents, error)) {
+    return false;
+  }
+  const int64_t num_voxels =
+      static_cast<int64_t>(height) * width * depth * channels;
+  if (static_cast<int64_t>(contents.size()) != num_voxels * VoxelSize(type)) {
+    *error = path + " does not hold a volume of the given shape and dtype";
+    return false;
+  }
+  volume->height = height;
+  volume->width = width;
+  volume->depth = depth;
+  volume->channels = channels;
+  volume->data.resize(num_voxels);
+  const bool swap = HostIsBigEndian();
+  for (int64_t i = 0; i < num_voxels; ++i) {
+    volume->data[i] = internal::LoadVoxel(contents.data(), i, type, swap);
+  }
+  return true;
+}
+
+namespace internal {
+
+const int kNiftiHeaderSize = 348;
+
+// Voxel layout of a NIfTI-1 volume, as given by its header.
+struct NiftiHeader {
+  bool swap;
+  int64_t sizes[7];
+  int64_t channels;
+  VoxelType type;
+  int64_t offset;
+  float slope;
+  float inter;
+};
+
+// Parses the header of the NIfTI-1 file 'path' from its first 'size' bytes.
+inline bool ParseNiftiHeader(const std::string& path, const char* header,
+                             size_t size, NiftiHeader* nifti,
+                             std::string* error) {
+  if (size < static_cast<size_t>(kNiftiHeaderSize + 4) ||
+      std::memcmp(header + 344, "n+1", 4) != 0) {
+    *error = path + " is not a single-file NIfTI-1 volume";
+    return false;
+  }
+  const bool swap = Load<int32_t>(header, false) != kNiftiHeaderSize;
+  if (Load<int32_t>(header, swap) != kNiftiHeaderSize) {
+    *error = path + " has an invalid NIfTI-1 header size";
+    return false;
+  }
+  nifti->swap = swap;
+
+  int16_t dim[8];
+  for (int i = 0; i < 8; ++i) {
+    dim[i] = Load<int16_t>(header + 40 + 2 * i, swap);
+  }
+  if (dim[0] < 1 || dim[0] > 7) {
+    *error = path + " has an invalid number of dimensions";
+    return false;
+  }
+  for (int i = 0; i < 7; ++i) {
+    nifti->sizes[i] = (i < dim[0]) ? dim[i + 1] : 1;
+    if (nifti->sizes[i] <= 0) {
+      *error = path + " has an empty dimension";
+      return false;
+    }
+  }
+  nifti->channels = 1;
+  for (int i = 3; i < 7; ++i) {
+    nifti->channels *= nifti->sizes[i];
+  }
+
+  switch (Load<int16_t>(header + 70, swap)) {
+    case 2: nifti->type = VoxelType::kUInt8; break;
+    case 4: nifti->type = VoxelType::kInt16; break;
+    case 8: nifti->type = VoxelType::kInt32; break;
+    case 16: nifti->type = VoxelType::kFloat32; break;
+    case 64: nifti->type = VoxelType::kFloat64; break;
+    case 256: nifti->type = VoxelType::kInt8; break;
+    case 512: nifti->type = VoxelType::kUInt16; break;
+    case 768: nifti->type = VoxelType::kUInt32; break;
+    default:
+      *error = path + " has an unsupported NIfTI-1 datatype";
+      return false;
+  }
+
+  nifti->offset = static_cast<int64_t>(Load<float>(header + 108, swap));
+  nifti->slope = Load<float>(header + 112, swap);
+  nifti->inter = Load<float>(header + 116, swap);
+  if (nifti->offset < kNiftiHeaderSize) {
+    *error = path + " is truncated";
+    return false;
+  }
+  return true;
+}
+
+}  // namespace internal
+
+// Returns in 'channels' the channel count of the NIfTI-1 volume 'path', read
+// from its header alone.
+inline bool ReadNiftiChannels(const std::string& path, int* channels,
+                              std::string* error) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    *error = "cannot open " + path;
+    return false;
+  }
+  char header[internal::kNiftiHeaderSize + 4];
+  file.read(header, sizeof(header));
+  internal::NiftiHeader nifti;
+  if (!internal::ParseNiftiHeader(path, header, file.gcount(), &nifti,
+                                  error)) {
+    return false;
+  }
+  *channels = nifti.channels;
+  return true;
+}
+
+// Reads an uncompressed single-file NIfTI-1 (.nii) volume of either byte
+// order. Voxel (i, j, k) of the file becomes voxel [i][j][k] of the volume,
+// and the 4th and higher dimensions are flattened into the channels. Voxel
+// values are scaled by scl_slope and scl_inter when the header sets them.
+inline bool ReadNiftiVolume(const std::string& path, Volume* volume,
+                            std::string* error) {
+  std::vector<char> contents;
+  if (!internal::ReadFile(path, &contents, error)) {
+    return false;
+  }
+  internal::NiftiHeader nifti;
+  if (!internal::ParseNiftiHeader(path, contents.data(), contents.size(),
+                                  &nifti, error)) {
+    return false;
+  }
+  const int64_t* sizes = nifti.sizes;
+  const int64_t channels = nifti.channels;
+  const VoxelType type = nifti.type;
+  const bool swap = nifti.swap;
+  const float slope = nifti.slope;
+  const float inter = nifti.inter;
+  const int64_t num_voxels = sizes[0] * sizes[1] * sizes[2] * channels;
+  if (static_cast<int64_t>(contents.size()) <
+      nifti.offset + num_voxels * VoxelSize(type)) {
+    *error = path + " is truncated";
+    return false;
+  }
+
+  volume->height = sizes[0];
+  volume->width = sizes[1];
+  volume->depth = sizes[2];
+  volume->channels = channels;
+  volume->data.resize(num_voxels);
+  // NIfTI stores the first dimension fastest: transpose to channels last,
+  // row-major.
+  const char* voxels = contents.data() + nifti.offset;
+  const bool scaled = slope != 0 && !(slope == 1 && inter == 0);
+  const int64_t plane = sizes[0] * sizes[1] * sizes[2];
+  float* out = volume->data.data();
+  for (int64_t i = 0; i < sizes[0]; ++i) {
+    for (int64_t j = 0; j < sizes[1]; ++j) {
+      for (int64_t k = 0; k < sizes[2]; ++k) {
+        const int64_t in = i + sizes[0] * (j + sizes[1] * k);
+        for (int64_t c = 0; c < channels; ++c) {
+          float value =
+              internal::LoadVoxel(voxels, in + c * plane, type, swap);
+          if (scaled) {
+            value = value * slope + inter;
+          }
+          *out++ = value;
+        }
+      }
+    }
+  }
+  return true;
+}
+
+}  // namespace roi_extract_3d
+
+#endif  // ROI_EXTRACT_3D_CC_TOOLS_VOLUME_IO_H_
@@ -0,0 +1,102 @@
+import os
+import subprocess
+import sys
+import tempfile
+import numpy as np
+import tensorflow as tf
+
+from crop_and_resize_3d import crop_and_resize_3d
+
+# Comment the following line to debug TF or libcuda issues
+os.environ['TF_CPP_MIN_LOG_LEVEL'] = '3'
+
+# Path of the roi_extract_3d binary, bazel-bin/roi_extract_3d/roi_extract_3d by
+# default.
+tool = sys.argv[1] if len(sys.argv) > 1 else os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                                                           '..', 'roi_extract_3d')
+
+
+def write_nifti(path, volume, slope=1.0, inter=0.0):
+    # Minimal single-file NIfTI-1 float32 volume of shape [H, W, D, C].
+    header = np.zeros(352, np.uint8)
+    header[0:4] = np.frombuffer(np.int32(348).tobytes(), np.uint8)
+    dims = np.array([5, volume.shape[0], volume.shape[1], volume.shape[2], 1, volume.shape[3], 1, 1], np.int16)
+    header[40:56] = np.frombuffer(dims.tobytes(), np.uint8)
+    header[70:74] = np.frombuffer(np.array([16, 32], np.int16).tobytes(), np.uint8)
+    header[108:120] = np.frombuffer(np.array([352, slope, inter], np.float32).tobytes(), np.uint8)
+    header[344:348] = np.frombuffer(b'n+1\0', np.uint8)
+    with open(path, 'wb') as f:
+        f.write(header.tobytes())
+        # NIfTI stores the first dimension fastest.
+        f.write(np.asfortranarray(volume.astype(np.float32)).tobytes(order='F'))
+
+
+def read_dataset(prefix):
+    header = np.fromfile(prefix + '.bin', '<u4', count=10)
+    num_crops = int(header[4]) | (int(header[5]) << 32)
+    shape = (num_crops, int(header[6]), int(header[7]), int(header[8]), int(header[9]))
+    return np.memmap(prefix + '.bin', '<f4', 'r', offset=int(header[3]), shape=shape)
+
+
+np.random.seed(0)
+volumes = [np.random.rand(8, 9, 10, 2).astype(np.float32) for _ in range(3)]
+corners = np.random.rand(7, 2, 3)
+boxes = np.concatenate([corners.min(1), corners.max(1)], 1).astype(np.float32)
+box_volume = np.array([0, 2, 1, 0, 2, 2, 1])
+crop_size = [4, 5, 6]
+
+#TestExtractNifti
+work_dir = tempfile.mkdtemp()
+paths = [os.path.join(work_dir, 'volume%d.nii' % i) for i in range(3)]
+for path, volume in zip(paths, volumes):
+    write_nifti(path, volume)
+with open(os.path.join(work_dir, 'boxes.txt'), 'w') as f:
+    for box, v in zip(boxes, box_volume):
+        f.write('%s %s\n' % (paths[v], ' '.join('%.9g' % c for c in box)))
+prefix = os.path.join(work_dir, 'crops')
+subprocess.check_call([tool, '--crop_size=%d,%d,%d' % tuple(crop_size), '--num_threads=2',
+                       os.path.join(work_dir, 'boxes.txt'), prefix])
+crops = read_dataset(prefix)
+control = crop_and_resize_3d(tf.constant(np.stack(volumes), tf.float32), tf.constant(boxes, tf.float32),
+                             tf.constant(box_volume, tf.int32), tf.constant(crop_size, tf.int32))
+if crops.shape == control.shape and np.allclose(crops, control.numpy(), atol=1e-5):
+    print('TestExtractNifti is OK.')
+else:
+    print('TestExtractNifti is not OK.')
+
+#TestExtractRaw
+raw_path = os.path.join(work_dir, 'volume.raw')
+volumes[0].astype('<f4').tofile(raw_path)
+with open(os.path.join(work_dir, 'raw_boxes.txt'), 'w') as f:
+    for box in boxes:
+        f.write('%s %s\n' % (raw_path, ' '.join('%.9g' % c for c in box)))
+subprocess.check_call([tool, '--crop_size=%d,%d,%d' % tuple(crop_size), '--shape=8,9,10,2',
+                       '--dtype=float32', '--method=nearest', os.path.join(work_dir, 'raw_boxes.txt'), prefix])
+crops = read_dataset(prefix)
+control = crop_and_resize_3d(tf.constant(volumes[0][None], tf.float32), tf.constant(boxes, tf.float32),
+                             tf.zeros([len(boxes)], tf.int32), tf.constant(crop_size, tf.int32),
+                             method_name='nearest')
+if crops.shape == control.shape and np.array_equal(crops, control.numpy()):
+    print('TestExtractRaw is OK.')
+else:
+    print('TestExtractRaw is not OK.')
+
+#TestIndex
+with open(prefix + '.idx') as f:
+    lines = [line.split('\t') for line in f if not line.startswith('#')]
+crop_bytes = 4 * np.prod(crop_size) * 2
+if [int(line[1]) for line in lines] == [4096 + i * crop_bytes for i in range(len(boxes))]:
+    print('TestIndex is OK.')
+else:
+    print('TestIndex is not OK.')
+#TestFailureRemovesOutputs
+with open(os.path.join(work_dir, 'missing_boxes.txt'), 'w') as f:
+    f.write('%s 0 0 0 1 1 1\n' % paths[0])
+    f.write('%s 0 0 0 1 1 1\n' % os.path.join(work_dir, 'missing.nii'))
+failed_prefix = os.path.join(work_dir, 'failed')
+returncode = subprocess.call([tool, '--crop_size=%d,%d,%d' % tuple(crop_size), '--num_threads=1',
+                              os.path.join(work_dir, 'missing_boxes.txt'), failed_prefix])
+if returncode != 0 and not os.path.exists(failed_prefix + '.bin') and not os.path.exists(failed_prefix + '.idx'):
+    print('TestFailureRemovesOutputs is OK.')
+else:
+    print('TestFailureRemovesOutputs is not OK.')
\ No newline at end of file
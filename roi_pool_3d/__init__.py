@@ -0,0 +1 @@
+from roi_pool_3d.python.ops.roi_pool_3d_ops import roi_pool_3d, roi_pool_3d_grad
\ No newline at end of file
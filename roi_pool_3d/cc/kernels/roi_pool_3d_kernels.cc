@@ -0,0 +1,405 @@
+#include "crop_and_resize_3d/cc/kernels/crop_and_resize_3d_checks.h"
+
+#include "tensorflow/core/framework/op_kernel.h"
+#include "tensorflow/core/framework/bounds_check.h"
+#include "tensorflow/core/util/work_sharder.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <utility>
+#include <vector>
+
+using namespace tensorflow;
+
+// Voxel bins of one box: bin i along an axis covers voxels [start[i], end[i]).
+struct BoxBins {
+  std::vector<int> y_start, y_end;
+  std::vector<int> x_start, x_end;
+  std::vector<int> z_start, z_end;
+};
+
+// Splits the extent of a box from 'start' to 'end' along one axis into
+// num_bins bins. The normalized coordinates map to voxels as in
+// CropAndResize3D, 0 and 1 being the first and last voxels of the axis. Bins
+// are clipped to the image and may be empty. As in CropAndResize3D, a box with
+// start > end is flipped: its first bin is the one nearest to 'start'.
+static inline void ComputeAxisBins(float start, float end, int image_size,
+                                   int num_bins, std::vector<int>* bin_start,
+                                   std::vector<int>* bin_end) {
+  const int roi_start = roundf(std::min(start, end) * (image_size - 1));
+  const int roi_end = roundf(std::max(start, end) * (image_size - 1));
+  const float bin_size = static_cast<float>(roi_end - roi_start + 1) / num_bins;
+  bin_start->resize(num_bins);
+  bin_end->resize(num_bins);
+  for (int i = 0; i < num_bins; ++i) {
+    const int lo = static_cast<int>(floorf(i * bin_size)) + roi_start;
+    const int hi = static_cast<int>(ceilf((i + 1) * bin_size)) + roi_start;
+    (*bin_start)[i] = std::min(std::max(lo, 0), image_size);
+    (*bin_end)[i] = std::min(std::max(hi, 0), image_size);
+  }
+  if (start > end) {
+    std::reverse(bin_start->begin(), bin_start->end());
+    std::reverse(bin_end->begin(), bin_end->end());
+  }
+}
+
+static inline void ComputeBoxBins(TTypes<float, 2>::ConstTensor boxes, int b,
+                                  int image_height, int image_width,
+                                  int image_depth, int pooled_height,
+                                  int pooled_width, int pooled_depth,
+                                  BoxBins* bins) {
+  ComputeAxisBins(boxes(b, 0), boxes(b, 3), image_height, pooled_height,
+                  &bins->y_start, &bins->y_end);
+  ComputeAxisBins(boxes(b, 1), boxes(b, 4), image_width, pooled_width,
+                  &bins->x_start, &bins->x_end);
+  ComputeAxisBins(boxes(b, 2), boxes(b, 5), image_depth, pooled_depth,
+                  &bins->z_start, &bins->z_end);
+}
+
+// Reduces every box to [pooled_height, pooled_width, pooled_depth] bins by
+// taking the max or the mean of each bin, per channel, straight from the
+// image. In max mode 'argmax' holds the voxel (y * image_width + x) *
+// image_depth + z of the maximum, and -1 for empty bins. In avg mode it is
+// empty. Empty bins pool to 0.
+class ROIPool3DOp : public OpKernel {
+public:
+  explicit ROIPool3DOp(OpKernelConstruction* context) : OpKernel(context) {
+    OP_REQUIRES_OK(context, context->GetAttr("pooling_mode", &pooling_mode_));
+    OP_REQUIRES(context, pooling_mode_ == "max" || pooling_mode_ == "avg",
+                errors::InvalidArgument(
+                    "pooling_mode must be 'max' or 'avg'", pooling_mode_));
+  }
+
+  void Compute(OpKernelContext* context) override {
+    const Tensor& image = context-> input(0);
+    const Tensor& boxes = context-> input(1);
+    const Tensor& box_index = context-> input(2);
+    const Tensor& pooled_size = context-> input(3);
+
+    OP_REQUIRES(context, image.dims() == 5,
+                      errors::InvalidArgument("input image must be 5-D",
+                                              image.shape().DebugString()));
+
+    const int batch_size = image.dim_size(0);
+    const int image_height = image.dim_size(1);
+    const int image_width = image.dim_size(2);
+    const int image_depth = image.dim_size(3);
+    const int depth = image.dim_size(4);
+    OP_REQUIRES(
+        context, image_height > 0 && image_width > 0 && image_depth > 0,
+        errors::InvalidArgument("image dimensions must be positive"));
+    int num_boxes = 0;
+    OP_REQUIRES_OK(
+        context, ParseAndCheckBoxSizes(boxes, box_index, &num_boxes));
+    OP_REQUIRES_OK(
+        context, CheckBoxIndexRange(box_index, num_boxes, batch_size));
+    OP_REQUIRES(context, pooled_size.dims() == 1,
+                      errors::InvalidArgument("pooled_size must be 1-D",
+                                              pooled_size.shape().DebugString()));
+    OP_REQUIRES(
+        context, pooled_size.dim_size(0) == 3,
+        errors::InvalidArgument("pooled_size must have three elements",
+                                pooled_size.shape().DebugString()));
+
+    auto pooled_size_vec = pooled_size.vec<int32>();
+    const int pooled_height = ::tensorflow::internal::SubtleMustCopy(pooled_size_vec(0));
+    const int pooled_width = ::tensorflow::internal::SubtleMustCopy(pooled_size_vec(1));
+    const int pooled_depth = ::tensorflow::internal::SubtleMustCopy(pooled_size_vec(2));
+    OP_REQUIRES(
+        context, pooled_height > 0 && pooled_width > 0 && pooled_depth > 0,
+        errors::InvalidArgument("pooled dimensions must be positive"));
+
+    const TensorShape output_shape({num_boxes, pooled_height, pooled_width,
+                                    pooled_depth, depth});
+    Tensor* pooled = NULL;
+    OP_REQUIRES_OK(context, context->allocate_output(0, output_shape, &pooled));
+    const bool max_pooling = pooling_mode_ == "max";
+    Tensor* argmax = NULL;
+    OP_REQUIRES_OK(context, context->allocate_output(
+                                1, max_pooling ? output_shape : TensorShape({0}),
+                                &argmax));
+
+    auto boxesT = boxes.tensor<float, 2>();
+    auto box_indexT = box_index.tensor<int32, 1>();
+    auto imageT = image.tensor<float, 5>();
+    auto pooledT = pooled->tensor<float, 5>();
+    int32* argmax_data = argmax->flat<int32>().data();
+
+    // Every box writes its own rows of the outputs, so boxes are pooled in
+    // parallel.
+    auto pool_boxes = [&](int64 start_box, int64 limit_box) {
+      BoxBins bins;
+      for (int b = start_box; b < limit_box; ++b) {
+        ComputeBoxBins(boxesT, b, image_height, image_width, image_depth,
+                       pooled_height, pooled_width, pooled_depth, &bins);
+        const int32 b_in = box_indexT(b);
+
+        for (int py = 0; py < pooled_height; ++py) {
+          const int y_start = bins.y_start[py];
+          const int y_end = bins.y_end[py];
+          for (int px = 0; px < pooled_width; ++px) {
+            const int x_start = bins.x_start[px];
+            const int x_end = bins.x_end[px];
+            for (int pz = 0; pz < pooled_depth; ++pz) {
+              const int z_start = bins.z_start[pz];
+              const int z_end = bins.z_end[pz];
+              float* out = &pooledT(b, py, px, pz, 0);
+              int32* out_argmax = nullptr;
+              if (max_pooling) {
+                out_argmax = argmax_data + (out - pooledT.data());
+                std::fill_n(out_argmax, depth, -1);
+              }
+              if (y_end <= y_start || x_end <= x_start || z_end <= z_start) {
+                std::fill_n(out, depth, 0.0f);
+                continue;
+              }
+
+              if (max_pooling) {
+                std::fill_n(out, depth, std::numeric_limits<float>::lowest());
+              } else {
+                std::fill_n(out, depth, 0.0f);
+              }
+              for (int y = y_start; y < y_end; ++y) {
+                for (int x = x_start; x < x_end; ++x) {
+                  for (int z = z_start; z < z_end; ++z) {
+                    const float* in = &imageT(b_in, y, x, z, 0);
+                    if (max_pooling) {
+                      const int32 index =
+                          (y * image_width + x) * image_depth + z;
+                      for (int d = 0; d < depth; ++d) {
+                        if (in[d] > out[d] || out_argmax[d] < 0) {
+                          out[d] = in[d];
+                          out_argmax[d] = index;
+                        }
+                      }
+                    } else {
+                      for (int d = 0; d < depth; ++d) {
+                        out[d] += in[d];
+                      }
+                    }
+                  }
+                }
+              }
+              if (!max_pooling) {
+                const float scale = 1.0f / ((y_end - y_start) *
+                                            (x_end - x_start) *
+                                            (z_end - z_start));
+                for (int d = 0; d < depth; ++d) {
+                  out[d] *= scale;
+                }
+              }
+            }
+          }
+        }
+      }
+    };
+
+    // Each box reads roughly its own region of the image once.
+    int64 total_box_volume = 0;
+    for (int b = 0; b < num_boxes; ++b) {
+      total_box_volume +=
+          static_cast<int64>(fabsf(boxesT(b, 3) - boxesT(b, 0)) * image_height + 1) *
+          static_cast<int64>(fabsf(boxesT(b, 4) - boxesT(b, 1)) * image_width + 1) *
+          static_cast<int64>(fabsf(boxesT(b, 5) - boxesT(b, 2)) * image_depth + 1);
+    }
+    const int64 cost_per_box =
+        std::max<int64>(total_box_volume / std::max(num_boxes, 1), 1) * depth;
+    auto worker_threads = context->device()->tensorflow_cpu_worker_threads();
+    Shard(worker_threads->num_threads, worker_threads->workers, num_boxes,
+          cost_per_box, pool_boxes);
+  }
+private:
+  string pooling_mode_ ;
+};
+
+REGISTER_KERNEL_BUILDER(Name("ROIPool3D").Device(DEVICE_CPU), ROIPool3DOp);
+
+// Routes the pooled gradients back to the image: to the argmax voxel in max
+// mode, spread evenly over the bin in avg mode.
+class ROIPool3DGradOp : public OpKernel {
+public:
+  explicit ROIPool3DGradOp(OpKernelConstruction* context) : OpKernel(context) {
+    OP_REQUIRES_OK(context, context->GetAttr("pooling_mode", &pooling_mode_));
+    OP_REQUIRES(context, pooling_mode_ == "max" || pooling_mode_ == "avg",
+                errors::InvalidArgument(
+                    "pooling_mode must be 'max' or 'avg'", pooling_mode_));
+  }
+
+  void Compute(OpKernelContext* context) override {
+    const Tensor& grads = context-> input(0);
+    const Tensor& argmax = context-> input(1);
+    const Tensor& boxes = context-> input(2);
+    const Tensor& box_index = context-> input(3);
+    const Tensor& image_size = context-> input(4);
+
+    OP_REQUIRES(context, grads.dims() == 5,
+                      errors::InvalidArgument("grads image must be 5-D",
+                                              grads.shape().DebugString()));
+    const bool max_pooling = pooling_mode_ == "max";
+    // argmax is only used, and only filled by ROIPool3D, in max mode.
+    OP_REQUIRES(context, !max_pooling || argmax.shape().IsSameSize(grads.shape()),
+                      errors::InvalidArgument("argmax and grads have incompatible shape",
+                                              argmax.shape().DebugString()));
+
+    const int pooled_height = grads.dim_size(1);
+    const int pooled_width = grads.dim_size(2);
+    const int pooled_depth = grads.dim_size(3);
+    OP_REQUIRES(
+        context, pooled_height > 0 && pooled_width > 0 && pooled_depth > 0,
+        errors::InvalidArgument("grads dimensions must be positive"));
+    int num_boxes = 0;
+    OP_REQUIRES_OK(
+        context, ParseAndCheckBoxSizes(boxes, box_index, &num_boxes));
+    OP_REQUIRES(
+        context, grads.dim_size(0) == num_boxes,
+        errors::InvalidArgument("boxes and grads have incompatible shape"));
+    OP_REQUIRES(context, image_size.dims() == 1,
+                      errors::InvalidArgument("image_size must be 1-D",
+                                              image_size.shape().DebugString()));
+    OP_REQUIRES(
+        context, image_size.dim_size(0) == 5,
+        errors::InvalidArgument("image_size must have five elements",
+                                image_size.shape().DebugString()));
+
+    auto image_size_vec = image_size.vec<int32>();
+    const int batch_size = ::tensorflow::internal::SubtleMustCopy(image_size_vec(0));
+    const int image_height = ::tensorflow::internal::SubtleMustCopy(image_size_vec(1));
+    const int image_width = ::tensorflow::internal::SubtleMustCopy(image_size_vec(2));
+    const int image_depth = ::tensorflow::internal::SubtleMustCopy(image_size_vec(3));
+    const int depth = ::tensorflow::internal::SubtleMustCopy(image_size_vec(4));
+    OP_REQUIRES(
+        context, image_height > 0 && image_width > 0 && image_depth > 0,
+        errors::InvalidArgument("image dimensions must be positive"));
+    OP_REQUIRES(
+        context, grads.dim_size(4) == depth,
+        errors::InvalidArgument("image_size and grads are incompatible"));
+    OP_REQUIRES_OK(
+        context, CheckBoxIndexRange(box_index, num_boxes, batch_size));
+
+    const int64 image_volume =
+        static_cast<int64>(image_height) * image_width * image_depth;
+    auto argmax_flat = argmax.flat<int32>();
+    for (int64 i = 0; max_pooling && i < argmax_flat.size(); ++i) {
+      OP_REQUIRES(context, argmax_flat(i) < image_volume,
+                  errors::InvalidArgument("argmax has values outside the image"));
+    }
+
+    Tensor* output = NULL;
+    OP_REQUIRES_OK(context, context->allocate_output(0, TensorShape({batch_size,
+      image_height, image_width, image_depth, depth}), &output));
+
+    auto gradsT = grads.tensor<float, 5>();
+    auto boxesT = boxes.tensor<float, 2>();
+    auto box_indexT = box_index.tensor<int32, 1>();
+    float* grads_image = output->flat<float>().data();
+    std::fill_n(grads_image, output->NumElements(), 0.0f);
+    const int64 pooled_volume =
+        static_cast<int64>(pooled_height) * pooled_width * pooled_depth;
+    const int64 row_size = static_cast<int64>(image_width) * image_depth * depth;
+    auto worker_threads = context->device()->tensorflow_cpu_worker_threads();
+
+    // In max mode every pooled gradient goes to a single value of the output.
+    // The (output offset, gradient index) pairs of each box are sorted by
+    // offset, that is by image row, once and in parallel over the boxes, so
+    // that each shard of rows below only visits the pairs it owns. Equal
+    // offsets keep the order of the gradients.
+    std::vector<std::vector<std::pair<int64, int64>>> box_targets(
+        max_pooling ? num_boxes : 0);
+    if (max_pooling) {
+      const int32* argmax_data = argmax_flat.data();
+      auto sort_boxes = [&](int64 start_box, int64 limit_box) {
+        for (int b = start_box; b < limit_box; ++b) {
+          const int64 image_offset =
+              static_cast<int64>(box_indexT(b)) * image_volume;
+          std::vector<std::pair<int64, int64>>& targets = box_targets[b];
+          for (int64 i = b * pooled_volume * depth;
+               i < (b + 1) * pooled_volume * depth; ++i) {
+            if (argmax_data[i] >= 0) {
+              targets.emplace_back(
+                  (image_offset + argmax_data[i]) * depth + i % depth, i);
+            }
+          }
+          std::sort(targets.begin(), targets.end());
+        }
+      };
+      Shard(worker_threads->num_threads, worker_threads->workers, num_boxes,
+            pooled_volume * depth * 10, sort_boxes);
+    }
+    const float* grads_data = grads.flat<float>().data();
+
+    // Several boxes may scatter into the same voxels, so the work is split
+    // over the image rows (batch_size * image_height of them) instead: every
+    // shard only writes the rows it owns.
+    auto scatter_rows = [&](int64 start_row, int64 limit_row) {
+      BoxBins bins;
+      for (int b = 0; b < num_boxes; ++b) {
+        const int32 b_in = box_indexT(b);
+        const int64 first_row = static_cast<int64>(b_in) * image_height;
+        const int y_lo = std::max<int64>(start_row - first_row, 0);
+        const int y_hi = std::min<int64>(limit_row - first_row, image_height);
+        if (y_lo >= y_hi) {
+          continue;
+        }
+        float* image_grad = grads_image + first_row * row_size;
+
+        if (max_pooling) {
+          const std::vector<std::pair<int64, int64>>& targets = box_targets[b];
+          const int64 limit_offset = (first_row + y_hi) * row_size;
+          auto target = std::lower_bound(
+              targets.begin(), targets.end(),
+              std::make_pair((first_row + y_lo) * row_size, int64{0}));
+          for (; target != targets.end() && target->first < limit_offset;
+               ++target) {
+            grads_image[target->first] += grads_data[target->second];
+          }
+          continue;
+        }
+
+        ComputeBoxBins(boxesT, b, image_height, image_width, image_depth,
+                       pooled_height, pooled_width, pooled_depth, &bins);
+        for (int py = 0; py < pooled_height; ++py) {
+          const int y_start = std::max(bins.y_start[py], y_lo);
+          const int y_end = std::min(bins.y_end[py], y_hi);
+          if (y_end <= y_start) {
+            continue;
+          }
+          for (int px = 0; px < pooled_width; ++px) {
+            const int x_start = bins.x_start[px];
+            const int x_end = bins.x_end[px];
+            for (int pz = 0; pz < pooled_depth; ++pz) {
+              const int z_start = bins.z_start[pz];
+              const int z_end = bins.z_end[pz];
+              if (x_end <= x_start || z_end <= z_start) {
+                continue;
+              }
+              const float scale =
+                  1.0f / ((bins.y_end[py] - bins.y_start[py]) *
+                          (x_end - x_start) * (z_end - z_start));
+              const float* g = &gradsT(b, py, px, pz, 0);
+              for (int y = y_start; y < y_end; ++y) {
+                for (int x = x_start; x < x_end; ++x) {
+                  for (int z = z_start; z < z_end; ++z) {
+                    float* out = image_grad +
+                        ((static_cast<int64>(y) * image_width + x) * image_depth + z) * depth;
+                    for (int d = 0; d < depth; ++d) {
+                      out[d] += g[d] * scale;
+                    }
+                  }
+                }
+              }
+            }
+          }
+        }
+      }
+    };
+
+    Shard(worker_threads->num_threads, worker_threads->workers,
+          static_cast<int64>(batch_size) * image_height, row_size,
+          scatter_rows);
+  }
+private:
+ string pooling_mode_ ;
+};
+
+REGISTER_KERNEL_BUILDER(Name("ROIPool3DGrad").Device(DEVICE_CPU), ROIPool3DGradOp);
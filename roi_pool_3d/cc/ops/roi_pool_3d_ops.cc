@@ -0,0 +1,98 @@
+#include "tensorflow/core/framework/op.h"
+#include "tensorflow/core/framework/shape_inference.h"
+
+using namespace tensorflow;
+
+namespace {
+
+// Sets outputs 0 and 1 to shape [num_boxes,height,width,depth,channel_dim],
+// where height and width and depth come from the pooled_size tensor. Output 1,
+// the argmax, is empty in avg mode.
+Status SetOutputsToPooledSize(::tensorflow::shape_inference::InferenceContext* c,
+                              ::tensorflow::shape_inference::DimensionHandle num_boxes_dim,
+                              int size_input_idx,
+                              ::tensorflow::shape_inference::DimensionHandle channel_dim) {
+  // Verify shape of size input.
+  ::tensorflow::shape_inference::ShapeHandle size;
+  TF_RETURN_IF_ERROR(c->WithRank(c->input(size_input_idx), 1, &size));
+  ::tensorflow::shape_inference::DimensionHandle unused;
+  TF_RETURN_IF_ERROR(c->WithValue(c->Dim(size, 0), 3, &unused));
+
+  // Get size values from the size tensor.
+  const Tensor* size_tensor = c->input_tensor(size_input_idx);
+  ::tensorflow::shape_inference::DimensionHandle width;
+  ::tensorflow::shape_inference::DimensionHandle height;
+  ::tensorflow::shape_inference::DimensionHandle depth;
+  if (size_tensor == nullptr) {
+    width = c->UnknownDim();
+    height = c->UnknownDim();
+    depth = c->UnknownDim();
+  } else {
+    if (size_tensor->dtype() != DT_INT32) {
+      return errors::InvalidArgument(
+          "Bad size input type for SetOutputsToPooledSize: Expected DT_INT32 "
+          "but got ",
+          DataTypeString(size_tensor->dtype()), " for input #", size_input_idx,
+          " in ", c->DebugString());
+    }
+    auto vec = size_tensor->vec<int32>();
+    height = c->MakeDim(vec(0));
+    width = c->MakeDim(vec(1));
+    depth = c->MakeDim(vec(2));
+  }
+  ::tensorflow::shape_inference::ShapeHandle out =
+      c->MakeShape({num_boxes_dim, height, width, depth, channel_dim});
+  c->set_output(0, out);
+  string pooling_mode;
+  TF_RETURN_IF_ERROR(c->GetAttr("pooling_mode", &pooling_mode));
+  c->set_output(1, pooling_mode == "max" ? out : c->Vector(0));
+  return Status::OK();
+}
+
+}
+
+REGISTER_OP("ROIPool3D")
+    .Input("image: float")
+    .Input("boxes: float")
+    .Input("box_index: int32")
+    .Input("pooled_size: int32")
+    .Output("pooled: float")
+    .Output("argmax: int32")
+    .Attr("pooling_mode: {'max', 'avg'} = 'max'")
+    .SetShapeFn([](::tensorflow::shape_inference::InferenceContext* c) {
+      // Get inputs and validate ranks.
+      ::tensorflow::shape_inference::ShapeHandle input;
+      TF_RETURN_IF_ERROR(c->WithRank(c->input(0), 5, &input));
+      ::tensorflow::shape_inference::ShapeHandle boxes;
+      TF_RETURN_IF_ERROR(c->WithRank(c->input(1), 2, &boxes));
+      ::tensorflow::shape_inference::ShapeHandle box_ind;
+      TF_RETURN_IF_ERROR(c->WithRank(c->input(2), 1, &box_ind));
+
+      // boxes[0] and box_ind[0] are both num_boxes.
+      ::tensorflow::shape_inference::DimensionHandle num_boxes_dim;
+      TF_RETURN_IF_ERROR(
+          c->Merge(c->Dim(boxes, 0), c->Dim(box_ind, 0), &num_boxes_dim));
+
+      // boxes.dim(1) is 6.
+      ::tensorflow::shape_inference::DimensionHandle unused;
+      TF_RETURN_IF_ERROR(c->WithValue(c->Dim(boxes, 1), 6, &unused));
+
+      return SetOutputsToPooledSize(c, num_boxes_dim, 3 /* size_input_idx */,
+                                    c->Dim(input, 4));
+    });
+
+REGISTER_OP("ROIPool3DGrad")
+    .Input("grads: float")
+    .Input("argmax: int32")
+    .Input("boxes: float")
+    .Input("box_index: int32")
+    .Input("image_size: int32")
+    .Output("output: float")
+    .Attr("pooling_mode: {'max', 'avg'} = 'max'")
+    .SetShapeFn([](::tensorflow::shape_inference::InferenceContext* c) {
+      ::tensorflow::shape_inference::ShapeHandle out;
+      TF_RETURN_IF_ERROR(c->MakeShapeFromShapeTensor(4, &out));
+      TF_RETURN_IF_ERROR(c->WithRank(out, 5, &out));
+      c->set_output(0, out);
+      return Status::OK();
+    });
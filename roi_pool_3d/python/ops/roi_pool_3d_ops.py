@@ -0,0 +1,35 @@
+from tensorflow.python.framework import dtypes
+from tensorflow.python.framework import load_library
+from tensorflow.python.framework import ops
+from tensorflow.python.ops import array_ops
+from tensorflow.python.platform import resource_loader
+
+
+roi_pool_3d_ops = load_library.load_op_library(
+    resource_loader.get_path_to_datafile('_roi_pool_3d_ops.so'))
+
+
+def roi_pool_3d(image, boxes, box_index, pooled_size, pooling_mode='max',
+                name=None):
+    """Max or average pools every box of `image` into `pooled_size` bins.
+
+    Boxes follow the crop_and_resize_3d conventions: a box whose start
+    exceeds its end along an axis is pooled flipped along that axis. Returns
+    the pooled tensor of shape [num_boxes, *pooled_size, channels] and, in
+    'max' mode, the argmax voxel of every bin (-1 for empty bins). In 'avg'
+    mode the argmax is empty.
+    """
+    return roi_pool_3d_ops.roi_pool3d(image, boxes, box_index, pooled_size,
+                                      pooling_mode=pooling_mode, name=name)
+
+
+roi_pool_3d_grad = roi_pool_3d_ops.roi_pool3d_grad
+
+
+@ops.RegisterGradient("ROIPool3D")
+def _roi_pool_3d_grad(op, grad, _):
+    image_size = array_ops.shape(op.inputs[0], out_type=dtypes.int32)
+    grad_image = roi_pool_3d_grad(grad, op.outputs[1], op.inputs[1],
+                                  op.inputs[2], image_size,
+                                  pooling_mode=op.get_attr('pooling_mode'))
+    return [grad_image, None, None, None]
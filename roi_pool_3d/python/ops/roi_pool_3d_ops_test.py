@@ -0,0 +1,142 @@
+import os
+import numpy as np
+import tensorflow as tf
+
+from roi_pool_3d import roi_pool_3d
+
+# Comment the following line to debug TF or libcuda issues
+os.environ['TF_CPP_MIN_LOG_LEVEL'] = '3'
+
+
+def roi_bins_from_numpy(box, image_size, pooled_size):
+    # Voxel ranges [start, end) of the bins of a box along each axis.
+    bins = []
+    for axis in range(3):
+        lo = min(box[axis], box[axis + 3]) * (image_size[axis] - 1)
+        hi = max(box[axis], box[axis + 3]) * (image_size[axis] - 1)
+        start = int(np.round(lo))
+        bin_size = (int(np.round(hi)) - start + 1) / pooled_size[axis]
+        axis_bins = [(int(np.clip(np.floor(p * bin_size) + start, 0, image_size[axis])),
+                      int(np.clip(np.ceil((p + 1) * bin_size) + start, 0, image_size[axis])))
+                     for p in range(pooled_size[axis])]
+        # Flipped boxes are pooled flipped, as in crop_and_resize_3d.
+        if box[axis] > box[axis + 3]:
+            axis_bins.reverse()
+        bins.append(axis_bins)
+    return bins
+
+
+def roi_pool_from_numpy(image, boxes, box_index, pooled_size, mode='max'):
+    pooled = np.zeros((np.shape(boxes)[0], *pooled_size, np.shape(image)[4]))
+    for i in range(np.shape(boxes)[0]):
+        bins = roi_bins_from_numpy(boxes[i], np.shape(image)[1:4], pooled_size)
+        for py, (y0, y1) in enumerate(bins[0]):
+            for px, (x0, x1) in enumerate(bins[1]):
+                for pz, (z0, z1) in enumerate(bins[2]):
+                    region = image[box_index[i], y0:y1, x0:x1, z0:z1, :]
+                    if region.size == 0:
+                        continue
+                    if mode == 'max':
+                        pooled[i, py, px, pz] = region.max(axis=(0, 1, 2))
+                    else:
+                        pooled[i, py, px, pz] = region.mean(axis=(0, 1, 2))
+    return pooled
+
+
+def roi_pool_grad_from_numpy(image, grads, boxes, box_index, pooled_size, mode='max'):
+    # Routes every pooled gradient to the first maximum of its bin, or evenly
+    # over its bin, summing over overlapping boxes.
+    grads_image = np.zeros(np.shape(image))
+    for i in range(np.shape(boxes)[0]):
+        bins = roi_bins_from_numpy(boxes[i], np.shape(image)[1:4], pooled_size)
+        for py, (y0, y1) in enumerate(bins[0]):
+            for px, (x0, x1) in enumerate(bins[1]):
+                for pz, (z0, z1) in enumerate(bins[2]):
+                    region = image[box_index[i], y0:y1, x0:x1, z0:z1, :]
+                    if region.size == 0:
+                        continue
+                    grads_region = grads_image[box_index[i], y0:y1, x0:x1, z0:z1, :]
+                    for d in range(np.shape(image)[4]):
+                        if mode == 'max':
+                            y, x, z = np.unravel_index(np.argmax(region[..., d]), region.shape[:3])
+                            grads_region[y, x, z, d] += grads[i, py, px, pz, d]
+                        else:
+                            grads_region[..., d] += grads[i, py, px, pz, d] / region[..., d].size
+    return grads_image
+
+
+image = np.arange(2 * 6 * 5 * 4 * 2, dtype=np.float32).reshape((2, 6, 5, 4, 2))
+image = np.sin(image)
+boxes = np.array([[0, 0, 0, 1, 1, 1], [0.2, 0.1, 0.3, 0.9, 0.7, 1], [1, 1, 1, 0.5, 0.5, 0.5]])
+box_index = np.array([0, 1, 1])
+pooled_size = [2, 2, 2]
+
+#TestROIPool3DMax
+control = roi_pool_from_numpy(image, boxes, box_index, pooled_size, mode='max')
+results, argmax = roi_pool_3d(tf.constant(image, tf.float32), tf.constant(boxes, tf.float32),
+                              tf.constant(box_index, tf.int32), tf.constant(pooled_size, tf.int32))
+if results.shape == control.shape and np.allclose(results.numpy(), control):
+    print('TestROIPool3DMax is OK.')
+else:
+    print('TestROIPool3DMax is not OK.')
+
+#TestROIPool3DAvg
+control = roi_pool_from_numpy(image, boxes, box_index, pooled_size, mode='avg')
+results, _ = roi_pool_3d(tf.constant(image, tf.float32), tf.constant(boxes, tf.float32),
+                         tf.constant(box_index, tf.int32), tf.constant(pooled_size, tf.int32),
+                         pooling_mode='avg')
+if results.shape == control.shape and np.allclose(results.numpy(), control, atol=1e-6):
+    print('TestROIPool3DAvg is OK.')
+else:
+    print('TestROIPool3DAvg is not OK.')
+
+#TestROIPool3DFlippedBox
+flipped = tf.constant(boxes[2:], tf.float32)
+unflipped = tf.constant(boxes[2:, [3, 4, 5, 0, 1, 2]], tf.float32)
+results, _ = roi_pool_3d(tf.constant(image, tf.float32), flipped, tf.constant(box_index[2:], tf.int32),
+                         tf.constant(pooled_size, tf.int32))
+control, _ = roi_pool_3d(tf.constant(image, tf.float32), unflipped, tf.constant(box_index[2:], tf.int32),
+                         tf.constant(pooled_size, tf.int32))
+if np.array_equal(results.numpy(), np.flip(control.numpy(), axis=(1, 2, 3))):
+    print('TestROIPool3DFlippedBox is OK.')
+else:
+    print('TestROIPool3DFlippedBox is not OK.')
+
+#TestROIPool3DAvgHasNoArgmax
+_, argmax = roi_pool_3d(tf.constant(image, tf.float32), tf.constant(boxes, tf.float32),
+                        tf.constant(box_index, tf.int32), tf.constant(pooled_size, tf.int32),
+                        pooling_mode='avg')
+if argmax.shape == (0,):
+    print('TestROIPool3DAvgHasNoArgmax is OK.')
+else:
+    print('TestROIPool3DAvgHasNoArgmax is not OK.')
+
+#TestROIPool3DGradient
+# Boxes 1, 2 and 4 overlap in image 1, boxes 0 and 3 in image 0, and boxes 2, 3
+# and 4 are flipped along some axes. Random upstream gradients check where each
+# one lands, not only their sum.
+grad_boxes = np.concatenate([boxes, [[0.8, 0.2, 0.1, 0.1, 0.9, 0.6], [0.1, 0.6, 0.9, 0.7, 0.1, 0.2]]])
+grad_box_index = np.concatenate([box_index, [0, 1]])
+upstream = np.random.RandomState(0).rand(len(grad_boxes), *pooled_size, np.shape(image)[4])
+for mode in ['max', 'avg']:
+    image_t = tf.constant(image, tf.float32)
+    with tf.GradientTape() as tape:
+        tape.watch(image_t)
+        results, _ = roi_pool_3d(image_t, tf.constant(grad_boxes, tf.float32),
+                                 tf.constant(grad_box_index, tf.int32), tf.constant(pooled_size, tf.int32),
+                                 pooling_mode=mode)
+        loss = tf.reduce_sum(results * tf.constant(upstream, tf.float32))
+    grad = tape.gradient(loss, image_t)
+    control = roi_pool_grad_from_numpy(image, upstream, grad_boxes, grad_box_index, pooled_size, mode=mode)
+    if grad.shape == control.shape and np.allclose(grad.numpy(), control, atol=1e-5):
+        print('TestROIPool3DGradient (%s) is OK.' % mode)
+    else:
+        print('TestROIPool3DGradient (%s) is not OK.' % mode)
+
+#TestInvalidBoxIndex
+try:
+    results = roi_pool_3d(tf.constant(image, tf.float32), tf.constant(boxes, tf.float32),
+                          tf.constant([0, 1, 2], tf.int32), tf.constant(pooled_size, tf.int32))
+except Exception as e:
+    if 'box_index has values outside [0, batch_size)' in str(e):
+        print('TestInvalidBoxIndex is OK.')
@@ -0,0 +1 @@
+from shared_batch_3d.python.ops.shared_batch_3d_ops import shared_batch_crop_and_resize_3d, shared_batch_non_max_suppression_3d, shared_batch_scheduler_3d_stats
\ No newline at end of file
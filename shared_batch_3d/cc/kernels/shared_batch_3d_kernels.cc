@@ -0,0 +1,246 @@
+#include "shared_batch_scheduler_3d.h"
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include "crop_and_resize_3d/cc/kernels/crop_and_resize_3d.h"
+#include "crop_and_resize_3d/cc/kernels/crop_and_resize_3d_checks.h"
+#include "non_max_suppression_3d/cc/kernels/non_max_suppression_3d_checks.h"
+#include "non_max_suppression_3d/cc/kernels/non_max_suppression_3d_cpu.h"
+#include "tensorflow/core/framework/op_kernel.h"
+#include "tensorflow/core/platform/cpu_info.h"
+
+using namespace tensorflow;
+
+// Looks up the scheduler described by the shared_name and scheduling
+// attributes of the op.
+static Status GetScheduler(OpKernelConstruction* context,
+                           SharedBatchScheduler3D** scheduler) {
+  string shared_name;
+  TF_RETURN_IF_ERROR(context->GetAttr("shared_name", &shared_name));
+  if (shared_name.empty()) {
+    shared_name = "shared_batch_3d";
+  }
+  SharedBatchScheduler3D::Options options;
+  TF_RETURN_IF_ERROR(context->GetAttr("num_threads", &options.num_threads));
+  if (options.num_threads == 0) {
+    options.num_threads = port::MaxParallelism();
+  }
+  TF_RETURN_IF_ERROR(
+      context->GetAttr("max_batch_size", &options.max_batch_size));
+  TF_RETURN_IF_ERROR(
+      context->GetAttr("batch_timeout_micros", &options.batch_timeout_micros));
+  TF_RETURN_IF_ERROR(
+      context->GetAttr("timeout_micros", &options.timeout_micros));
+  TF_RETURN_IF_ERROR(
+      context->GetAttr("max_enqueued_tasks", &options.max_enqueued_tasks));
+  return SharedBatchScheduler3D::GetOrCreate(shared_name, options, scheduler);
+}
+
+// CropAndResize3D whose boxes are cropped on the shared scheduler, together
+// with the boxes of the calls batched with it.
+class SharedBatchCropAndResize3DOp : public AsyncOpKernel {
+public:
+  explicit SharedBatchCropAndResize3DOp(OpKernelConstruction* context)
+      : AsyncOpKernel(context) {
+    OP_REQUIRES_OK(context, context->GetAttr("method_name", &method_name_));
+    OP_REQUIRES(context, method_name_ == "trilinear" || method_name_ == "nearest",
+                errors::InvalidArgument(
+                    "method must be 'trilinear' or 'nearest'", method_name_));
+    OP_REQUIRES_OK(context, context->GetAttr("extrapolation_value",
+                                             &extrapolation_value_));
+    OP_REQUIRES_OK(context, GetScheduler(context, &scheduler_));
+  }
+
+  ~SharedBatchCropAndResize3DOp() override {
+    if (scheduler_ != nullptr) {
+      scheduler_->Unref();
+    }
+  }
+
+  void ComputeAsync(OpKernelContext* context, DoneCallback done) override {
+    const Tensor& image = context-> input(0);
+    const Tensor& boxes = context-> input(1);
+    const Tensor& box_index = context-> input(2);
+    const Tensor& crop_size = context-> input(3);
+    const Tensor& num_valid = context-> input(4);
+
+    // Same checks as CropAndResize3D, so both ops accept the same inputs.
+    CropAndResize3DSizes sizes;
+    std::shared_ptr<std::vector<bool>> box_is_valid(new std::vector<bool>);
+    OP_REQUIRES_OK_ASYNC(context, ParseAndCheckCropAndResize3DInputs(
+                                      image, boxes, box_index, crop_size,
+                                      num_valid, &sizes, box_is_valid.get()),
+                         done);
+    const int image_height = sizes.image_height;
+    const int image_width = sizes.image_width;
+    const int image_depth = sizes.image_depth;
+    const int depth = sizes.depth;
+    const int num_boxes = sizes.num_boxes;
+    const int crop_height = sizes.crop_height;
+    const int crop_width = sizes.crop_width;
+    const int crop_depth = sizes.crop_depth;
+
+    Tensor* cropped = NULL;
+    OP_REQUIRES_OK_ASYNC(context, context->allocate_output(0, TensorShape({num_boxes,
+      crop_height, crop_width, crop_depth, depth}), &cropped), done);
+    if (num_boxes == 0) {
+      done();
+      return;
+    }
+
+    // The inputs and the output stay alive until done is called.
+    const float* image_data = image.flat<float>().data();
+    const float* boxes_data = boxes.flat<float>().data();
+    const int32* box_index_data = box_index.flat<int32>().data();
+    float* cropped_data = cropped->flat<float>().data();
+    const int64 image_volume = static_cast<int64>(image_height) * image_width *
+                               image_depth * depth;
+    const int64 crop_volume =
+        static_cast<int64>(crop_height) * crop_width * crop_depth * depth;
+    const bool trilinear = method_name_ == "trilinear";
+    const float extrapolation_value = extrapolation_value_;
+
+    std::unique_ptr<SharedBatchTask3D> task(new SharedBatchTask3D);
+    task->num_units = num_boxes;
+    task->cost_per_unit = crop_volume * (trilinear ? 30 : 4);
+    task->work = [=](int64 start_box, int64 limit_box) {
+      for (int64 b = start_box; b < limit_box; ++b) {
+        // Padded boxes are filled like boxes lying outside the image.
+        if (!(*box_is_valid)[b]) {
+          std::fill_n(cropped_data + b * crop_volume, crop_volume,
+                      extrapolation_value);
+          continue;
+        }
+        functor::CropAndResize3DBox(
+            image_data + box_index_data[b] * image_volume, image_height,
+            image_width, image_depth, depth, boxes_data + 6 * b, crop_height,
+            crop_width, crop_depth, trilinear, extrapolation_value,
+            cropped_data + b * crop_volume);
+      }
+    };
+    task->done = [context, done](const Status& status) {
+      context->SetStatus(status);
+      done();
+    };
+    OP_REQUIRES_OK_ASYNC(context, scheduler_->Schedule(std::move(task)), done);
+  }
+private:
+  string method_name_ ;
+  float extrapolation_value_ ;
+  SharedBatchScheduler3D* scheduler_ = nullptr;
+};
+
+REGISTER_KERNEL_BUILDER(Name("SharedBatchCropAndResize3D").Device(DEVICE_CPU),
+                        SharedBatchCropAndResize3DOp);
+
+// NonMaxSuppression3D run on the shared scheduler, in parallel with the
+// other calls batched with it.
+class SharedBatchNonMaxSuppression3DOp : public AsyncOpKernel {
+ public:
+  explicit SharedBatchNonMaxSuppression3DOp(OpKernelConstruction* context)
+      : AsyncOpKernel(context) {
+    OP_REQUIRES_OK(context, context->GetAttr("iou_threshold", &iou_threshold_));
+    OP_REQUIRES(context, iou_threshold_ >= 0 && iou_threshold_ <= 1,
+                errors::InvalidArgument("iou_threshold must be in [0, 1]"));
+    OP_REQUIRES_OK(context, GetScheduler(context, &scheduler_));
+  }
+
+  ~SharedBatchNonMaxSuppression3DOp() override {
+    if (scheduler_ != nullptr) {
+      scheduler_->Unref();
+    }
+  }
+
+  void ComputeAsync(OpKernelContext* context, DoneCallback done) override {
+    // boxes: [num_boxes, 6]
+    const Tensor& boxes = context->input(0);
+    // scores: [num_boxes]
+    const Tensor& scores = context->input(1);
+    // max_output_size: scalar
+    const Tensor& max_output_size = context->input(2);
+    // num_valid: scalar
+    const Tensor& num_valid = context->input(3);
+
+    // Same checks as NonMaxSuppression3D, so both ops accept the same inputs.
+    int num_boxes = 0;
+    int output_size = 0;
+    OP_REQUIRES_OK_ASYNC(context, ParseAndCheckNonMaxSuppression3DInputs(
+                                      boxes, scores, max_output_size, num_valid,
+                                      &num_boxes, &output_size),
+                         done);
+
+    const float* boxes_data = boxes.flat<float>().data();
+    const float* scores_data = scores.flat<float>().data();
+    const float iou_threshold = iou_threshold_;
+    std::shared_ptr<std::vector<int>> selected(new std::vector<int>);
+
+    std::unique_ptr<SharedBatchTask3D> task(new SharedBatchTask3D);
+    task->num_units = 1;
+    task->cost_per_unit = static_cast<int64>(num_boxes) * 100;
+    task->work = [=](int64 start, int64 limit) {
+      functor::NonMaxSuppression3DGreedy(boxes_data, scores_data, num_boxes,
+                                         iou_threshold, output_size,
+                                         selected.get());
+    };
+    // The output size is only known once the task ran.
+    task->done = [context, done, selected](const Status& status) {
+      OP_REQUIRES_OK_ASYNC(context, status, done);
+      Tensor* output_indices = nullptr;
+      OP_REQUIRES_OK_ASYNC(
+          context,
+          context->allocate_output(
+              0, TensorShape({static_cast<int64>(selected->size())}),
+              &output_indices),
+          done);
+      std::copy_n(selected->begin(), selected->size(),
+                  output_indices->flat<int>().data());
+      done();
+    };
+    OP_REQUIRES_OK_ASYNC(context, scheduler_->Schedule(std::move(task)), done);
+  }
+
+ private:
+  float iou_threshold_;
+  SharedBatchScheduler3D* scheduler_ = nullptr;
+};
+
+REGISTER_KERNEL_BUILDER(
+    Name("SharedBatchNonMaxSuppression3D").Device(DEVICE_CPU),
+    SharedBatchNonMaxSuppression3DOp);
+
+
+// Reports the batching counters of the scheduler named shared_name.
+class SharedBatchScheduler3DStatsOp : public OpKernel {
+ public:
+  explicit SharedBatchScheduler3DStatsOp(OpKernelConstruction* context)
+      : OpKernel(context) {
+    OP_REQUIRES_OK(context, context->GetAttr("shared_name", &shared_name_));
+    if (shared_name_.empty()) {
+      shared_name_ = "shared_batch_3d";
+    }
+  }
+
+  void Compute(OpKernelContext* context) override {
+    SharedBatchScheduler3D* scheduler = nullptr;
+    OP_REQUIRES_OK(context,
+                   SharedBatchScheduler3D::Lookup(shared_name_, &scheduler));
+    core::ScopedUnref unref(scheduler);
+    int64 num_batches = 0;
+    int64 num_tasks = 0;
+    scheduler->GetStats(&num_batches, &num_tasks);
+
+    Tensor* output = nullptr;
+    OP_REQUIRES_OK(context, context->allocate_output(0, TensorShape({}), &output));
+    output->scalar<int64>()() = num_batches;
+    OP_REQUIRES_OK(context, context->allocate_output(1, TensorShape({}), &output));
+    output->scalar<int64>()() = num_tasks;
+  }
+
+ private:
+  string shared_name_;
+};
+
+REGISTER_KERNEL_BUILDER(Name("SharedBatchScheduler3DStats").Device(DEVICE_CPU),
+                        SharedBatchScheduler3DStatsOp);
\ No newline at end of file
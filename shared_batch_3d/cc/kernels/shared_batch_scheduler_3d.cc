@@ -0,0 +1,261 @@
+#include "shared_batch_scheduler_3d.h"
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+
+#include "tensorflow/core/lib/core/errors.h"
+
+namespace tensorflow {
+
+namespace {
+
+struct SchedulerRegistry {
+  mutex mu;
+  // Schedulers are never released, so that sessions created later reuse the
+  // same worker pool.
+  std::map<string, SharedBatchScheduler3D*> schedulers GUARDED_BY(mu);
+  std::map<string, SharedBatchScheduler3D::Options> options GUARDED_BY(mu);
+};
+
+SchedulerRegistry* GetSchedulerRegistry() {
+  static SchedulerRegistry* registry = new SchedulerRegistry;
+  return registry;
+}
+
+bool SameOptions(const SharedBatchScheduler3D::Options& a,
+                 const SharedBatchScheduler3D::Options& b) {
+  return a.num_threads == b.num_threads &&
+         a.max_batch_size == b.max_batch_size &&
+         a.batch_timeout_micros == b.batch_timeout_micros &&
+         a.timeout_micros == b.timeout_micros &&
+         a.max_enqueued_tasks == b.max_enqueued_tasks;
+}
+
+Status TaskTimedOut(int64 timeout_micros) {
+  return errors::DeadlineExceeded(
+      "task waited more than ", timeout_micros,
+      " microseconds in the shared batch scheduler");
+}
+
+}  // namespace
+
+Status SharedBatchScheduler3D::GetOrCreate(const string& name,
+                                           const Options& options,
+                                           SharedBatchScheduler3D** scheduler) {
+  if (options.num_threads <= 0) {
+    return errors::InvalidArgument("num_threads must be positive");
+  }
+  if (options.max_batch_size <= 0) {
+    return errors::InvalidArgument("max_batch_size must be positive");
+  }
+  if (options.batch_timeout_micros < 0 || options.timeout_micros < 0) {
+    return errors::InvalidArgument("timeouts must be non-negative");
+  }
+  if (options.max_enqueued_tasks <= 0) {
+    return errors::InvalidArgument("max_enqueued_tasks must be positive");
+  }
+
+  SchedulerRegistry* registry = GetSchedulerRegistry();
+  mutex_lock l(registry->mu);
+  auto it = registry->schedulers.find(name);
+  if (it == registry->schedulers.end()) {
+    it = registry->schedulers
+             .emplace(name, new SharedBatchScheduler3D(name, options))
+             .first;
+    registry->options.emplace(name, options);
+  } else if (!SameOptions(registry->options[name], options)) {
+    return errors::InvalidArgument("shared batch scheduler '", name,
+                                   "' already exists with other options");
+  }
+  it->second->Ref();
+  *scheduler = it->second;
+  return Status::OK();
+}
+
+Status SharedBatchScheduler3D::Lookup(const string& name,
+                                      SharedBatchScheduler3D** scheduler) {
+  SchedulerRegistry* registry = GetSchedulerRegistry();
+  mutex_lock l(registry->mu);
+  auto it = registry->schedulers.find(name);
+  if (it == registry->schedulers.end()) {
+    return errors::NotFound("no shared batch scheduler named '", name, "'");
+  }
+  it->second->Ref();
+  *scheduler = it->second;
+  return Status::OK();
+}
+
+SharedBatchScheduler3D::SharedBatchScheduler3D(const string& name,
+                                               const Options& options)
+    : options_(options) {
+  workers_.reset(new thread::ThreadPool(Env::Default(), "shared_batch_3d",
+                                        options_.num_threads));
+  batching_thread_.reset(Env::Default()->StartThread(
+      ThreadOptions(), "shared_batch_3d_" + name,
+      [this]() { ScheduleBatches(); }));
+  if (options_.timeout_micros > 0) {
+    expiry_thread_.reset(Env::Default()->StartThread(
+        ThreadOptions(), "shared_batch_3d_expiry_" + name,
+        [this]() { ExpireTasks(); }));
+  }
+}
+
+SharedBatchScheduler3D::~SharedBatchScheduler3D() {
+  {
+    mutex_lock l(mu_);
+    stopped_ = true;
+  }
+  queue_changed_.notify_all();
+  // Joins the batching thread, which runs the tasks left in the queue first.
+  batching_thread_.reset();
+  expiry_thread_.reset();
+}
+
+Status SharedBatchScheduler3D::Schedule(
+    std::unique_ptr<SharedBatchTask3D> task) {
+  {
+    mutex_lock l(mu_);
+    // max_enqueued_tasks was checked to be positive in GetOrCreate.
+    if (queue_.size() >= static_cast<size_t>(options_.max_enqueued_tasks)) {
+      return errors::Unavailable(
+          "shared batch scheduler queue is full (max_enqueued_tasks = ",
+          options_.max_enqueued_tasks, ")");
+    }
+    task->enqueue_time_micros = Env::Default()->NowMicros();
+    queue_.push_back(std::move(task));
+  }
+  queue_changed_.notify_all();
+  return Status::OK();
+}
+
+void SharedBatchScheduler3D::GetStats(int64* num_batches, int64* num_tasks) {
+  mutex_lock l(mu_);
+  *num_batches = num_batches_;
+  *num_tasks = num_tasks_;
+}
+
+void SharedBatchScheduler3D::ScheduleBatches() {
+  for (;;) {
+    std::vector<std::unique_ptr<SharedBatchTask3D>> batch;
+    {
+      mutex_lock l(mu_);
+      while (!stopped_ && queue_.empty()) {
+        queue_changed_.wait(l);
+      }
+      if (queue_.empty()) {
+        return;
+      }
+      // Waits for the batch to fill up, at most batch_timeout_micros after
+      // its oldest task was scheduled.
+      const uint64 deadline_micros =
+          queue_.front()->enqueue_time_micros + options_.batch_timeout_micros;
+      while (!stopped_ &&
+             queue_.size() < static_cast<size_t>(options_.max_batch_size)) {
+        const uint64 now_micros = Env::Default()->NowMicros();
+        if (now_micros >= deadline_micros) {
+          break;
+        }
+        queue_changed_.wait_for(
+            l, std::chrono::microseconds(deadline_micros - now_micros));
+      }
+      const int batch_size =
+          std::min<size_t>(queue_.size(), options_.max_batch_size);
+      for (int i = 0; i < batch_size; ++i) {
+        batch.push_back(std::move(queue_.front()));
+        queue_.pop_front();
+      }
+    }
+    // The tasks may all have expired while the batch was filling up.
+    if (!batch.empty()) {
+      RunBatch(&batch);
+    }
+  }
+}
+
+void SharedBatchScheduler3D::ExpireTasks() {
+  const uint64 timeout_micros = options_.timeout_micros;
+  for (;;) {
+    std::vector<std::unique_ptr<SharedBatchTask3D>> expired;
+    {
+      mutex_lock l(mu_);
+      if (stopped_) {
+        return;
+      }
+      // The queue is in scheduling order, so the expired tasks are in front.
+      const uint64 now_micros = Env::Default()->NowMicros();
+      while (!queue_.empty() &&
+             now_micros - queue_.front()->enqueue_time_micros >
+                 timeout_micros) {
+        expired.push_back(std::move(queue_.front()));
+        queue_.pop_front();
+      }
+      if (expired.empty()) {
+        if (queue_.empty()) {
+          queue_changed_.wait(l);
+        } else {
+          queue_changed_.wait_for(
+              l, std::chrono::microseconds(
+                     queue_.front()->enqueue_time_micros + timeout_micros + 1 -
+                     now_micros));
+        }
+        continue;
+      }
+    }
+    queue_changed_.notify_all();
+    for (auto& task : expired) {
+      task->done(TaskTimedOut(options_.timeout_micros));
+    }
+  }
+}
+
+void SharedBatchScheduler3D::RunBatch(
+    std::vector<std::unique_ptr<SharedBatchTask3D>>* batch) {
+  // Tasks that waited too long are dropped, the others are laid out one after
+  // the other in a single range of units.
+  const uint64 now_micros = Env::Default()->NowMicros();
+  std::vector<SharedBatchTask3D*> tasks;
+  std::vector<int64> first_unit(1, 0);
+  int64 total_cost = 0;
+  for (auto& task : *batch) {
+    if (options_.timeout_micros > 0 &&
+        now_micros - task->enqueue_time_micros >
+            static_cast<uint64>(options_.timeout_micros)) {
+      task->done(TaskTimedOut(options_.timeout_micros));
+      continue;
+    }
+    tasks.push_back(task.get());
+    first_unit.push_back(first_unit.back() + task->num_units);
+    total_cost += task->num_units * task->cost_per_unit;
+  }
+
+  const int64 total_units = first_unit.back();
+  if (total_units > 0) {
+    auto run_units = [&tasks, &first_unit](int64 start, int64 limit) {
+      // Index of the task holding unit 'start'.
+      int t = std::upper_bound(first_unit.begin(), first_unit.end(), start) -
+              first_unit.begin() - 1;
+      for (; start < limit; ++t) {
+        const int64 task_limit = std::min(limit, first_unit[t + 1]);
+        if (task_limit > start) {
+          tasks[t]->work(start - first_unit[t], task_limit - first_unit[t]);
+        }
+        start = task_limit;
+      }
+    };
+    workers_->ParallelFor(total_units,
+                          std::max<int64>(total_cost / total_units, 1),
+                          run_units);
+  }
+
+  {
+    mutex_lock l(mu_);
+    ++num_batches_;
+    num_tasks_ += tasks.size();
+  }
+  for (SharedBatchTask3D* task : tasks) {
+    task->done(Status::OK());
+  }
+}
+
+}  // namespace tensorflow
@@ -0,0 +1,98 @@
+#ifndef SHARED_BATCH_3D_CC_KERNELS_SHARED_BATCH_SCHEDULER_3D_H_
+#define SHARED_BATCH_3D_CC_KERNELS_SHARED_BATCH_SCHEDULER_3D_H_
+
+#include <deque>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "tensorflow/core/lib/core/refcount.h"
+#include "tensorflow/core/lib/core/status.h"
+#include "tensorflow/core/lib/core/threadpool.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/mutex.h"
+#include "tensorflow/core/platform/thread_annotations.h"
+
+namespace tensorflow {
+
+// One call of a shared batch op. Its work is split into num_units
+// independent units so that the tasks of a batch can be spread together over
+// the worker pool.
+struct SharedBatchTask3D {
+  int64 num_units = 0;
+  // Rough cost of a unit, as expected by thread::ThreadPool::ParallelFor.
+  int64 cost_per_unit = 1;
+  // Runs units [start, limit). Called concurrently on disjoint ranges.
+  std::function<void(int64, int64)> work;
+  // Called once, after all the units ran or with the error that prevented
+  // the task from running.
+  std::function<void(const Status&)> done;
+  uint64 enqueue_time_micros = 0;
+};
+
+// Coalesces the tasks scheduled from any session within a short window into
+// batches, and runs every batch at once on a worker pool shared by all of its
+// callers. Schedulers live for the whole process and are looked up by name.
+class SharedBatchScheduler3D : public core::RefCounted {
+ public:
+  struct Options {
+    // Size of the worker pool.
+    int32 num_threads = 1;
+    // A batch is run as soon as it holds max_batch_size tasks...
+    int32 max_batch_size = 64;
+    // ...or batch_timeout_micros after its oldest task was scheduled.
+    int64 batch_timeout_micros = 1000;
+    // Tasks still waiting timeout_micros after being scheduled fail with
+    // DEADLINE_EXCEEDED, as soon as the deadline passes, even while another
+    // batch runs. 0 disables the check.
+    int64 timeout_micros = 0;
+    // Scheduling fails with UNAVAILABLE beyond this many waiting tasks.
+    int32 max_enqueued_tasks = 1024;
+  };
+
+  // Sets *scheduler to the scheduler called 'name', creating it with
+  // 'options' on first use. Later lookups must pass the same options. The
+  // caller owns a reference on *scheduler.
+  static Status GetOrCreate(const string& name, const Options& options,
+                            SharedBatchScheduler3D** scheduler);
+
+  // Sets *scheduler to the existing scheduler called 'name'. The caller owns
+  // a reference on *scheduler.
+  static Status Lookup(const string& name, SharedBatchScheduler3D** scheduler);
+
+  // Queues 'task' for the next batch. task->done is called once the task ran,
+  // unless an error is returned here.
+  Status Schedule(std::unique_ptr<SharedBatchTask3D> task);
+
+  // Number of batches run so far, and of the tasks they ran. Tasks that
+  // timed out are not counted.
+  void GetStats(int64* num_batches, int64* num_tasks);
+
+ private:
+  SharedBatchScheduler3D(const string& name, const Options& options);
+  ~SharedBatchScheduler3D() override;
+
+  // Body of the thread forming the batches.
+  void ScheduleBatches();
+  // Body of the thread failing the tasks that waited timeout_micros in the
+  // queue. Only started when timeout_micros is set.
+  void ExpireTasks();
+  // Runs the units of every task of 'batch' on the worker pool, then calls
+  // their done callbacks.
+  void RunBatch(std::vector<std::unique_ptr<SharedBatchTask3D>>* batch);
+
+  const Options options_;
+  mutex mu_;
+  condition_variable queue_changed_;
+  std::deque<std::unique_ptr<SharedBatchTask3D>> queue_ GUARDED_BY(mu_);
+  bool stopped_ GUARDED_BY(mu_) = false;
+  int64 num_batches_ GUARDED_BY(mu_) = 0;
+  int64 num_tasks_ GUARDED_BY(mu_) = 0;
+  std::unique_ptr<thread::ThreadPool> workers_;
+  std::unique_ptr<Thread> batching_thread_;
+  std::unique_ptr<Thread> expiry_thread_;
+};
+
+}  // namespace tensorflow
+
+#endif  // SHARED_BATCH_3D_CC_KERNELS_SHARED_BATCH_SCHEDULER_3D_H_
@@ -0,0 +1,109 @@
+#include "tensorflow/core/framework/op.h"
+#include "tensorflow/core/framework/shape_inference.h"
+
+using namespace tensorflow;
+
+// Both ops run on the process-wide scheduler named shared_name: calls made
+// from any session within batch_timeout_micros of each other are run together
+// on its num_threads workers. Every op naming the same scheduler must use the
+// same scheduling attributes.
+
+REGISTER_OP("SharedBatchCropAndResize3D")
+    .Input("image: float")
+    .Input("boxes: float")
+    .Input("box_index: int32")
+    .Input("crop_size: int32")
+    .Input("num_valid: int32")
+    .Output("crops: float")
+    .Attr("method_name: {'trilinear', 'nearest'} = 'trilinear'")
+    .Attr("extrapolation_value: float = 0")
+    .Attr("shared_name: string = ''")
+    .Attr("num_threads: int = 0")
+    .Attr("max_batch_size: int = 64")
+    .Attr("batch_timeout_micros: int = 1000")
+    .Attr("timeout_micros: int = 0")
+    .Attr("max_enqueued_tasks: int = 1024")
+    .SetShapeFn([](::tensorflow::shape_inference::InferenceContext* c) {
+      // Get inputs and validate ranks.
+      ::tensorflow::shape_inference::ShapeHandle input;
+      TF_RETURN_IF_ERROR(c->WithRank(c->input(0), 5, &input));
+      ::tensorflow::shape_inference::ShapeHandle boxes;
+      TF_RETURN_IF_ERROR(c->WithRank(c->input(1), 2, &boxes));
+      ::tensorflow::shape_inference::ShapeHandle box_ind;
+      TF_RETURN_IF_ERROR(c->WithRank(c->input(2), 1, &box_ind));
+
+      // boxes[0] and box_ind[0] are both num_boxes.
+      ::tensorflow::shape_inference::DimensionHandle num_boxes_dim;
+      TF_RETURN_IF_ERROR(
+          c->Merge(c->Dim(boxes, 0), c->Dim(box_ind, 0), &num_boxes_dim));
+
+      // boxes.dim(1) is 6.
+      ::tensorflow::shape_inference::DimensionHandle unused;
+      TF_RETURN_IF_ERROR(c->WithValue(c->Dim(boxes, 1), 6, &unused));
+
+      // crop_size holds the three crop dimensions.
+      ::tensorflow::shape_inference::ShapeHandle crop_size;
+      TF_RETURN_IF_ERROR(c->WithRank(c->input(3), 1, &crop_size));
+      TF_RETURN_IF_ERROR(c->WithValue(c->Dim(crop_size, 0), 3, &unused));
+      ::tensorflow::shape_inference::ShapeHandle crop_shape;
+      TF_RETURN_IF_ERROR(c->MakeShapeFromShapeTensor(3, &crop_shape));
+
+      // num_valid is a scalar or holds one count per image.
+      ::tensorflow::shape_inference::ShapeHandle num_valid;
+      TF_RETURN_IF_ERROR(c->WithRankAtMost(c->input(4), 1, &num_valid));
+
+      ::tensorflow::shape_inference::ShapeHandle out;
+      TF_RETURN_IF_ERROR(
+          c->Concatenate(c->Vector(num_boxes_dim), crop_shape, &out));
+      TF_RETURN_IF_ERROR(
+          c->Concatenate(out, c->Vector(c->Dim(input, 4)), &out));
+      c->set_output(0, out);
+      return Status::OK();
+    });
+
+REGISTER_OP("SharedBatchNonMaxSuppression3D")
+    .Input("boxes: float")
+    .Input("scores: float")
+    .Input("max_output_size: int32")
+    .Input("num_valid: int32")
+    .Output("selected_indices: int32")
+    .Attr("iou_threshold: float = 0.5")
+    .Attr("shared_name: string = ''")
+    .Attr("num_threads: int = 0")
+    .Attr("max_batch_size: int = 64")
+    .Attr("batch_timeout_micros: int = 1000")
+    .Attr("timeout_micros: int = 0")
+    .Attr("max_enqueued_tasks: int = 1024")
+    .SetShapeFn([](::tensorflow::shape_inference::InferenceContext* c) {
+      // Get inputs and validate ranks.
+      ::tensorflow::shape_inference::ShapeHandle boxes;
+      TF_RETURN_IF_ERROR(c->WithRank(c->input(0), 2, &boxes));
+      ::tensorflow::shape_inference::ShapeHandle scores;
+      TF_RETURN_IF_ERROR(c->WithRank(c->input(1), 1, &scores));
+      ::tensorflow::shape_inference::ShapeHandle max_output_size;
+      TF_RETURN_IF_ERROR(c->WithRank(c->input(2), 0, &max_output_size));
+      ::tensorflow::shape_inference::ShapeHandle num_valid;
+      TF_RETURN_IF_ERROR(c->WithRank(c->input(3), 0, &num_valid));
+      ::tensorflow::shape_inference::DimensionHandle unused;
+      // The boxes[0] and scores[0] are both num_boxes.
+      TF_RETURN_IF_ERROR(
+          c->Merge(c->Dim(boxes, 0), c->Dim(scores, 0), &unused));
+      // The boxes[1] is 6.
+      TF_RETURN_IF_ERROR(c->WithValue(c->Dim(boxes, 1), 6, &unused));
+
+      c->set_output(0, c->Vector(c->UnknownDim()));
+      return Status::OK();
+    });
+
+// Number of batches run by the scheduler named shared_name, and of the tasks
+// they ran.
+REGISTER_OP("SharedBatchScheduler3DStats")
+    .Output("num_batches: int64")
+    .Output("num_tasks: int64")
+    .Attr("shared_name: string = ''")
+    .SetIsStateful()
+    .SetShapeFn([](::tensorflow::shape_inference::InferenceContext* c) {
+      c->set_output(0, c->Scalar());
+      c->set_output(1, c->Scalar());
+      return Status::OK();
+    });
@@ -0,0 +1,61 @@
+from tensorflow.python.framework import load_library
+from tensorflow.python.platform import resource_loader
+
+
+shared_batch_3d_ops = load_library.load_op_library(
+    resource_loader.get_path_to_datafile('_shared_batch_3d_ops.so'))
+
+
+def shared_batch_crop_and_resize_3d(image, boxes, box_index, crop_size,
+                                    method_name='trilinear',
+                                    extrapolation_value=0, num_valid=-1,
+                                    shared_name='', num_threads=0, max_batch_size=64,
+                                    batch_timeout_micros=1000,
+                                    timeout_micros=0, max_enqueued_tasks=1024,
+                                    name=None):
+    """crop_and_resize_3d run on the process-wide scheduler `shared_name`.
+
+    Calls made from any thread or session within `batch_timeout_micros` of
+    each other, up to `max_batch_size` of them, are cropped together on the
+    `num_threads` workers of the scheduler (0 uses every core). Calls waiting
+    longer than `timeout_micros` (if positive) fail with DeadlineExceeded.
+    Every op naming the same scheduler must pass the same scheduling options.
+    `num_valid` marks padded boxes as in crop_and_resize_3d.
+    """
+    return shared_batch_3d_ops.shared_batch_crop_and_resize3d(
+        image, boxes, box_index, crop_size, num_valid, method_name=method_name,
+        extrapolation_value=extrapolation_value, shared_name=shared_name,
+        num_threads=num_threads, max_batch_size=max_batch_size,
+        batch_timeout_micros=batch_timeout_micros,
+        timeout_micros=timeout_micros, max_enqueued_tasks=max_enqueued_tasks,
+        name=name)
+
+
+def shared_batch_non_max_suppression_3d(boxes, scores, max_output_size,
+                                        iou_threshold=0.5, num_valid=-1,
+                                        shared_name='', num_threads=0,
+                                        max_batch_size=64,
+                                        batch_timeout_micros=1000,
+                                        timeout_micros=0,
+                                        max_enqueued_tasks=1024, name=None):
+    """non_max_suppression_3d run on the process-wide scheduler `shared_name`.
+
+    The scheduling options are those of shared_batch_crop_and_resize_3d.
+    `num_valid` marks padded boxes as in non_max_suppression_3d.
+    """
+    return shared_batch_3d_ops.shared_batch_non_max_suppression3d(
+        boxes, scores, max_output_size, num_valid,
+        iou_threshold=iou_threshold,
+        shared_name=shared_name, num_threads=num_threads,
+        max_batch_size=max_batch_size,
+        batch_timeout_micros=batch_timeout_micros,
+        timeout_micros=timeout_micros, max_enqueued_tasks=max_enqueued_tasks,
+        name=name)
+
+
+def shared_batch_scheduler_3d_stats(shared_name='', name=None):
+    """Returns the number of batches run by the scheduler `shared_name`, and
+    the number of calls they ran (calls that timed out are not counted).
+    """
+    return shared_batch_3d_ops.shared_batch_scheduler3d_stats(
+        shared_name=shared_name, name=name)
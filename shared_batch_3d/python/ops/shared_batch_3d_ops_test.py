@@ -0,0 +1,199 @@
+import os
+import time
+import threading
+import numpy as np
+import tensorflow as tf
+
+from crop_and_resize_3d import crop_and_resize_3d
+from non_max_suppression_3d import non_max_suppression_3d
+from shared_batch_3d import shared_batch_crop_and_resize_3d, shared_batch_non_max_suppression_3d, shared_batch_scheduler_3d_stats
+
+# Comment the following line to debug TF or libcuda issues
+os.environ['TF_CPP_MIN_LOG_LEVEL'] = '3'
+
+np.random.seed(0)
+num_calls = 16
+image = tf.constant(np.random.rand(2, 10, 11, 12, 3), tf.float32)
+crop_size = tf.constant([4, 5, 6], tf.int32)
+boxes_list = []
+box_index_list = []
+for i in range(num_calls):
+    corners = np.random.rand(i % 4 + 1, 2, 3)
+    boxes_list.append(tf.constant(np.concatenate([corners.min(1), corners.max(1)], 1), tf.float32))
+    box_index_list.append(tf.constant(np.random.randint(0, 2, i % 4 + 1), tf.int32))
+
+
+def run_concurrently(fn):
+    results = [None] * num_calls
+    errors = []
+
+    def call(i):
+        try:
+            results[i] = fn(i)
+        except Exception as e:
+            errors.append(e)
+
+    threads = [threading.Thread(target=call, args=(i,)) for i in range(num_calls)]
+    for thread in threads:
+        thread.start()
+    for thread in threads:
+        thread.join()
+    return results, errors
+
+
+#TestSharedBatchCropAndResize
+for method in ['trilinear', 'nearest']:
+    results, errors = run_concurrently(
+        lambda i: shared_batch_crop_and_resize_3d(image, boxes_list[i], box_index_list[i], crop_size,
+                                                  method_name=method, shared_name='test_crop',
+                                                  num_threads=4, max_batch_size=8,
+                                                  batch_timeout_micros=5000))
+    ok = not errors
+    for i in range(num_calls):
+        control = crop_and_resize_3d(image, boxes_list[i], box_index_list[i], crop_size, method_name=method)
+        ok = ok and np.array_equal(results[i].numpy(), control.numpy())
+    if ok:
+        print('TestSharedBatchCropAndResize (%s) is OK.' % method)
+    else:
+        print('TestSharedBatchCropAndResize (%s) is not OK.' % method)
+
+#TestSharedBatchNonMaxSuppression
+scores_list = [tf.constant(np.random.rand(boxes.shape[0]), tf.float32) for boxes in boxes_list]
+results, errors = run_concurrently(
+    lambda i: shared_batch_non_max_suppression_3d(boxes_list[i], scores_list[i], 3, iou_threshold=0.3,
+                                                  shared_name='test_nms', num_threads=4,
+                                                  max_batch_size=8, batch_timeout_micros=5000))
+ok = not errors
+for i in range(num_calls):
+    control = non_max_suppression_3d(boxes_list[i], scores_list[i], 3, iou_threshold=0.3)
+    ok = ok and np.array_equal(results[i].numpy(), control.numpy())
+if ok:
+    print('TestSharedBatchNonMaxSuppression is OK.')
+else:
+    print('TestSharedBatchNonMaxSuppression is not OK.')
+
+#TestMismatchedSchedulerOptions
+try:
+    shared_batch_non_max_suppression_3d(boxes_list[0], scores_list[0], 3, shared_name='test_nms',
+                                        num_threads=2)
+    print('TestMismatchedSchedulerOptions is not OK.')
+except Exception as e:
+    if 'already exists with other options' in str(e):
+        print('TestMismatchedSchedulerOptions is OK.')
+    else:
+        print('TestMismatchedSchedulerOptions is not OK.')
+
+#TestEmptyBoxes
+results = shared_batch_crop_and_resize_3d(image, tf.zeros([0, 6], tf.float32), tf.zeros([0], tf.int32),
+                                          crop_size, shared_name='test_crop', num_threads=4,
+                                          max_batch_size=8, batch_timeout_micros=5000)
+if results.shape == (0, 4, 5, 6, 3):
+    print('TestEmptyBoxes is OK.')
+else:
+    print('TestEmptyBoxes is not OK.')
+
+#TestPaddedBoxes
+padded_boxes = tf.concat([boxes_list[3], tf.ones([2, 6], tf.float32)], 0)
+padded_box_index = tf.concat([box_index_list[3], tf.zeros([2], tf.int32)], 0)
+padded_scores = tf.concat([scores_list[3], tf.ones([2], tf.float32)], 0)
+ok = True
+for num_valid in [boxes_list[3].shape[0], tf.constant([1, 1], tf.int32)]:
+    results = shared_batch_crop_and_resize_3d(image, padded_boxes, padded_box_index, crop_size,
+                                              extrapolation_value=-1, num_valid=num_valid,
+                                              shared_name='test_crop', num_threads=4,
+                                              max_batch_size=8, batch_timeout_micros=5000)
+    control = crop_and_resize_3d(image, padded_boxes, padded_box_index, crop_size,
+                                 extrapolation_value=-1, num_valid=num_valid)
+    ok = ok and np.array_equal(results.numpy(), control.numpy())
+results = shared_batch_non_max_suppression_3d(padded_boxes, padded_scores, 6, iou_threshold=0.3,
+                                              num_valid=boxes_list[3].shape[0], shared_name='test_nms',
+                                              num_threads=4, max_batch_size=8,
+                                              batch_timeout_micros=5000)
+control = non_max_suppression_3d(padded_boxes, padded_scores, 6, iou_threshold=0.3,
+                                 num_valid=boxes_list[3].shape[0])
+ok = ok and np.array_equal(results.numpy(), control.numpy())
+if ok:
+    print('TestPaddedBoxes is OK.')
+else:
+    print('TestPaddedBoxes is not OK.')
+
+#TestNegativeMaxOutputSize
+num_failed = 0
+for nms in [lambda: non_max_suppression_3d(boxes_list[0], scores_list[0], -1),
+            lambda: shared_batch_non_max_suppression_3d(boxes_list[0], scores_list[0], -1,
+                                                        iou_threshold=0.3, shared_name='test_nms',
+                                                        num_threads=4, max_batch_size=8,
+                                                        batch_timeout_micros=5000)]:
+    try:
+        nms()
+    except tf.errors.InvalidArgumentError:
+        num_failed += 1
+if num_failed == 2:
+    print('TestNegativeMaxOutputSize is OK.')
+else:
+    print('TestNegativeMaxOutputSize is not OK.')
+
+#TestCallsCoalesceIntoOneBatch
+@tf.function
+def crop_four_times():
+    # The four calls do not depend on each other, so they are all scheduled
+    # before the first batch fills up.
+    return [shared_batch_crop_and_resize_3d(image, boxes_list[i], box_index_list[i], crop_size,
+                                            shared_name='test_coalesce', num_threads=4,
+                                            max_batch_size=4, batch_timeout_micros=10000000)
+            for i in range(4)]
+results = crop_four_times()
+num_batches, num_tasks = shared_batch_scheduler_3d_stats(shared_name='test_coalesce')
+ok = num_batches.numpy() == 1 and num_tasks.numpy() == 4
+for i in range(4):
+    control = crop_and_resize_3d(image, boxes_list[i], box_index_list[i], crop_size)
+    ok = ok and np.array_equal(results[i].numpy(), control.numpy())
+if ok:
+    print('TestCallsCoalesceIntoOneBatch is OK.')
+else:
+    print('TestCallsCoalesceIntoOneBatch is not OK.')
+
+#TestTimeout
+try:
+    shared_batch_crop_and_resize_3d(image, boxes_list[0], box_index_list[0], crop_size,
+                                    shared_name='test_timeout', num_threads=4, max_batch_size=8,
+                                    batch_timeout_micros=200000, timeout_micros=1000)
+    print('TestTimeout is not OK.')
+except tf.errors.DeadlineExceededError:
+    num_batches, num_tasks = shared_batch_scheduler_3d_stats(shared_name='test_timeout')
+    if num_tasks.numpy() == 0:
+        print('TestTimeout is OK.')
+    else:
+        print('TestTimeout is not OK.')
+
+#TestTimeoutWhileWaiting
+# The call expires while its partial batch waits to fill up, long before the
+# batch timeout.
+start = time.time()
+try:
+    shared_batch_crop_and_resize_3d(image, boxes_list[0], box_index_list[0], crop_size,
+                                    shared_name='test_timeout_while_waiting', num_threads=4,
+                                    max_batch_size=8, batch_timeout_micros=5000000,
+                                    timeout_micros=1000)
+    print('TestTimeoutWhileWaiting is not OK.')
+except tf.errors.DeadlineExceededError:
+    if time.time() - start < 2:
+        print('TestTimeoutWhileWaiting is OK.')
+    else:
+        print('TestTimeoutWhileWaiting is not OK.')
+
+#TestQueueFull
+@tf.function
+def crop_twice():
+    # The first call fills the queue, which only holds one task until the
+    # batch times out.
+    return [shared_batch_crop_and_resize_3d(image, boxes_list[i], box_index_list[i], crop_size,
+                                            shared_name='test_queue_full', num_threads=4,
+                                            max_batch_size=2, batch_timeout_micros=1000000,
+                                            max_enqueued_tasks=1)
+            for i in range(2)]
+try:
+    crop_twice()
+    print('TestQueueFull is not OK.')
+except tf.errors.UnavailableError:
+    print('TestQueueFull is OK.')
\ No newline at end of file
@@ -0,0 +1 @@
+from slice_stack_crop.python.ops.slice_stack_crop_ops import slice_stack_crop, slice_stack_crop_grad_image
\ No newline at end of file
@@ -0,0 +1,384 @@
+#include "crop_and_resize_3d/cc/kernels/crop_and_resize_3d.h"
+#include "crop_and_resize_3d/cc/kernels/crop_and_resize_3d_checks.h"
+
+#include "tensorflow/core/framework/op_kernel.h"
+#include "tensorflow/core/framework/bounds_check.h"
+#include "tensorflow/core/util/work_sharder.h"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <vector>
+
+using namespace tensorflow;
+
+// How a [height, width, depth, channels] image is cut into slice stacks:
+// slices are taken along image axis 'slice_axis' and resized over the
+// 'row_axis' and 'col_axis' axes, in image order.
+struct SliceStackLayout {
+  int slice_axis;
+  int row_axis;
+  int col_axis;
+  int sizes[3];
+  int64 strides[3];
+};
+
+static inline SliceStackLayout MakeSliceStackLayout(int axis, int image_height,
+                                                    int image_width,
+                                                    int image_depth,
+                                                    int depth) {
+  SliceStackLayout layout;
+  layout.slice_axis = axis;
+  layout.row_axis = (axis == 0) ? 1 : 0;
+  layout.col_axis = (axis == 2) ? 1 : 2;
+  layout.sizes[0] = image_height;
+  layout.sizes[1] = image_width;
+  layout.sizes[2] = image_depth;
+  layout.strides[2] = depth;
+  layout.strides[1] = layout.strides[2] * image_depth;
+  layout.strides[0] = layout.strides[1] * image_width;
+  return layout;
+}
+
+// Returns the first of the num_slices neighbouring slices of 'box', which are
+// centered on the slice nearest to the center of the box. With an even count
+// the extra slice is taken after the center.
+static inline int FirstSlice(const SliceStackLayout& layout, const float* box,
+                             int num_slices) {
+  const int axis = layout.slice_axis;
+  const int center =
+      roundf(0.5 * (box[axis] + box[axis + 3]) * (layout.sizes[axis] - 1));
+  return center - (num_slices - 1) / 2;
+}
+
+// Bilinear sampling tables of the rows and columns of the slices of 'box'.
+static inline void ComputePlaneSamples(
+    const SliceStackLayout& layout, const float* box, int crop_height,
+    int crop_width, std::vector<functor::CropAxisSample>* row_samples,
+    std::vector<functor::CropAxisSample>* col_samples) {
+  row_samples->resize(crop_height);
+  col_samples->resize(crop_width);
+  functor::ComputeCropAxisSamples(box[layout.row_axis],
+                                  box[layout.row_axis + 3],
+                                  layout.sizes[layout.row_axis], crop_height,
+                                  row_samples->data());
+  functor::ComputeCropAxisSamples(box[layout.col_axis],
+                                  box[layout.col_axis + 3],
+                                  layout.sizes[layout.col_axis], crop_width,
+                                  col_samples->data());
+}
+
+// Takes, for every box, num_slices neighbouring full-resolution slices of the
+// image along 'axis' and resizes each of them bilinearly to crop_size over the
+// two other axes. The sampling tables are those of CropAndResize3D. Slices
+// outside of the image are filled with extrapolation_value.
+class SliceStackCropOp : public OpKernel {
+public:
+  explicit SliceStackCropOp(OpKernelConstruction* context) : OpKernel(context) {
+    OP_REQUIRES_OK(context, context->GetAttr("num_slices", &num_slices_));
+    OP_REQUIRES_OK(context, context->GetAttr("axis", &axis_));
+    OP_REQUIRES(context, axis_ >= 0 && axis_ <= 2,
+                errors::InvalidArgument("axis must be 0, 1 or 2, got ", axis_));
+    OP_REQUIRES_OK(context, context->GetAttr("extrapolation_value",
+                                             &extrapolation_value_));
+  }
+
+  void Compute(OpKernelContext* context) override {
+    const Tensor& image = context-> input(0);
+    const Tensor& boxes = context-> input(1);
+    const Tensor& box_index = context-> input(2);
+    const Tensor& crop_size = context-> input(3);
+
+    OP_REQUIRES(context, image.dims() == 5,
+                      errors::InvalidArgument("input image must be 5-D",
+                                              image.shape().DebugString()));
+
+    const int batch_size = image.dim_size(0);
+    const int image_height = image.dim_size(1);
+    const int image_width = image.dim_size(2);
+    const int image_depth = image.dim_size(3);
+    const int depth = image.dim_size(4);
+    OP_REQUIRES(
+        context, image_height > 0 && image_width > 0 && image_depth > 0,
+        errors::InvalidArgument("image dimensions must be positive"));
+    int num_boxes = 0;
+    OP_REQUIRES_OK(
+        context, ParseAndCheckBoxSizes(boxes, box_index, &num_boxes));
+    OP_REQUIRES_OK(
+        context, CheckBoxIndexRange(box_index, num_boxes, batch_size));
+    OP_REQUIRES(context, crop_size.dims() == 1,
+                      errors::InvalidArgument("crop_size must be 1-D",
+                                              crop_size.shape().DebugString()));
+    OP_REQUIRES(
+        context, crop_size.dim_size(0) == 2,
+        errors::InvalidArgument("crop_size must have two elements",
+                                crop_size.shape().DebugString()));
+
+    auto crop_size_vec = crop_size.vec<int32>();
+    const int crop_height = ::tensorflow::internal::SubtleMustCopy(crop_size_vec(0));
+    const int crop_width = ::tensorflow::internal::SubtleMustCopy(crop_size_vec(1));
+    OP_REQUIRES(
+        context, crop_height > 0 && crop_width > 0,
+        errors::InvalidArgument("crop dimensions must be positive"));
+
+    Tensor* cropped = NULL;
+    OP_REQUIRES_OK(context, context->allocate_output(0, TensorShape({num_boxes,
+      num_slices_, crop_height, crop_width, depth}), &cropped));
+
+    const float* image_data = image.flat<float>().data();
+    const float* boxes_data = boxes.flat<float>().data();
+    auto box_indexT = box_index.tensor<int32, 1>();
+    float* cropped_data = cropped->flat<float>().data();
+    const SliceStackLayout layout = MakeSliceStackLayout(
+        axis_, image_height, image_width, image_depth, depth);
+    const int64 image_volume = layout.strides[0] * image_height;
+    const int64 slice_stride = layout.strides[layout.slice_axis];
+    const int64 row_stride = layout.strides[layout.row_axis];
+    const int64 col_stride = layout.strides[layout.col_axis];
+    const int64 crop_plane = static_cast<int64>(crop_height) * crop_width * depth;
+    const int num_slices = num_slices_;
+    const float extrapolation_value = extrapolation_value_;
+
+    // Every box writes its own stack, so boxes are cropped in parallel.
+    auto crop_boxes = [&](int64 start_box, int64 limit_box) {
+      std::vector<functor::CropAxisSample> row_samples;
+      std::vector<functor::CropAxisSample> col_samples;
+      for (int b = start_box; b < limit_box; ++b) {
+        const float* box = boxes_data + 6 * b;
+        ComputePlaneSamples(layout, box, crop_height, crop_width,
+                            &row_samples, &col_samples);
+        const int first_slice = FirstSlice(layout, box, num_slices);
+        const float* image_b = image_data + box_indexT(b) * image_volume;
+
+        for (int s = 0; s < num_slices; ++s) {
+          float* plane = cropped_data + (static_cast<int64>(b) * num_slices + s) * crop_plane;
+          const int slice = first_slice + s;
+          if (!FastBoundsCheck(slice, layout.sizes[layout.slice_axis])) {
+            std::fill_n(plane, crop_plane, extrapolation_value);
+            continue;
+          }
+          const float* image_slice = image_b + slice * slice_stride;
+
+          for (int i = 0; i < crop_height; ++i) {
+            float* crop_row = plane + static_cast<int64>(i) * crop_width * depth;
+            const functor::CropAxisSample& rs = row_samples[i];
+            if (!rs.valid) {
+              std::fill_n(crop_row, static_cast<int64>(crop_width) * depth,
+                          extrapolation_value);
+              continue;
+            }
+            const float* top = image_slice + rs.lower * row_stride;
+            const float* bottom = image_slice + rs.upper * row_stride;
+            const float row_lerp = rs.lerp;
+
+            for (int j = 0; j < crop_width; ++j) {
+              float* out = crop_row + j * depth;
+              const functor::CropAxisSample& cs = col_samples[j];
+              if (!cs.valid) {
+                std::fill_n(out, depth, extrapolation_value);
+                continue;
+              }
+              const float* top_left = top + cs.lower * col_stride;
+              const float* top_right = top + cs.upper * col_stride;
+              const float* bottom_left = bottom + cs.lower * col_stride;
+              const float* bottom_right = bottom + cs.upper * col_stride;
+              const float col_lerp = cs.lerp;
+              for (int d = 0; d < depth; ++d) {
+                const float top_value = top_left[d] + (top_right[d] - top_left[d]) * col_lerp;
+                const float bottom_value = bottom_left[d] + (bottom_right[d] - bottom_left[d]) * col_lerp;
+                out[d] = top_value + (bottom_value - top_value) * row_lerp;
+              }
+            }
+          }
+        }
+      }
+    };
+
+    const int64 cost_per_box = static_cast<int64>(num_slices) * crop_plane * 10;
+    auto worker_threads = context->device()->tensorflow_cpu_worker_threads();
+    Shard(worker_threads->num_threads, worker_threads->workers, num_boxes,
+          cost_per_box, crop_boxes);
+  }
+private:
+  int num_slices_ ;
+  int axis_ ;
+  float extrapolation_value_ ;
+};
+
+REGISTER_KERNEL_BUILDER(Name("SliceStackCrop").Device(DEVICE_CPU), SliceStackCropOp);
+
+// Scatters the gradients of the slice stacks back to the image with the
+// bilinear weights of the forward pass.
+class SliceStackCropGradImageOp : public OpKernel {
+public:
+  explicit SliceStackCropGradImageOp(OpKernelConstruction* context) : OpKernel(context) {
+    OP_REQUIRES_OK(context, context->GetAttr("axis", &axis_));
+    OP_REQUIRES(context, axis_ >= 0 && axis_ <= 2,
+                errors::InvalidArgument("axis must be 0, 1 or 2, got ", axis_));
+  }
+
+  void Compute(OpKernelContext* context) override {
+    const Tensor& grads = context-> input(0);
+    const Tensor& boxes = context-> input(1);
+    const Tensor& box_index = context-> input(2);
+    const Tensor& image_size = context-> input(3);
+
+    OP_REQUIRES(context, grads.dims() == 5,
+                      errors::InvalidArgument("grads image must be 5-D",
+                                              grads.shape().DebugString()));
+
+    const int num_slices = grads.dim_size(1);
+    const int crop_height = grads.dim_size(2);
+    const int crop_width = grads.dim_size(3);
+    OP_REQUIRES(
+        context, num_slices > 0 && crop_height > 0 && crop_width > 0,
+        errors::InvalidArgument("grads dimensions must be positive"));
+    int num_boxes = 0;
+    OP_REQUIRES_OK(
+        context, ParseAndCheckBoxSizes(boxes, box_index, &num_boxes));
+    OP_REQUIRES(
+        context, grads.dim_size(0) == num_boxes,
+        errors::InvalidArgument("boxes and grads have incompatible shape"));
+    OP_REQUIRES(context, image_size.dims() == 1,
+                      errors::InvalidArgument("image_size must be 1-D",
+                                              image_size.shape().DebugString()));
+    OP_REQUIRES(
+        context, image_size.dim_size(0) == 5,
+        errors::InvalidArgument("image_size must have five elements",
+                                image_size.shape().DebugString()));
+
+    auto image_size_vec = image_size.vec<int32>();
+    const int batch_size = ::tensorflow::internal::SubtleMustCopy(image_size_vec(0));
+    const int image_height = ::tensorflow::internal::SubtleMustCopy(image_size_vec(1));
+    const int image_width = ::tensorflow::internal::SubtleMustCopy(image_size_vec(2));
+    const int image_depth = ::tensorflow::internal::SubtleMustCopy(image_size_vec(3));
+    const int depth = ::tensorflow::internal::SubtleMustCopy(image_size_vec(4));
+    OP_REQUIRES(
+        context, image_height > 0 && image_width > 0 && image_depth > 0,
+        errors::InvalidArgument("image dimensions must be positive"));
+    OP_REQUIRES(
+        context, grads.dim_size(4) == depth,
+        errors::InvalidArgument("image_size and grads are incompatible"));
+    OP_REQUIRES_OK(
+        context, CheckBoxIndexRange(box_index, num_boxes, batch_size));
+
+    Tensor* output = NULL;
+    OP_REQUIRES_OK(context, context->allocate_output(0, TensorShape({batch_size,
+      image_height, image_width, image_depth, depth}), &output));
+
+    const float* grads_data = grads.flat<float>().data();
+    const float* boxes_data = boxes.flat<float>().data();
+    auto box_indexT = box_index.tensor<int32, 1>();
+    float* grads_image = output->flat<float>().data();
+    std::fill_n(grads_image, output->NumElements(), 0.0f);
+
+    const SliceStackLayout layout = MakeSliceStackLayout(
+        axis_, image_height, image_width, image_depth, depth);
+    const int64 image_volume = layout.strides[0] * image_height;
+    const int64 slice_stride = layout.strides[layout.slice_axis];
+    const int64 row_stride = layout.strides[layout.row_axis];
+    const int64 col_stride = layout.strides[layout.col_axis];
+    const int64 crop_plane = static_cast<int64>(crop_height) * crop_width * depth;
+
+    // The sampling tables of the boxes and which of their slices have a
+    // non-zero upstream gradient are found once, box by box in parallel.
+    // Slices whose upstream gradient is all zeros would only scatter zeros,
+    // so they are skipped.
+    std::vector<std::vector<functor::CropAxisSample>> row_samples(num_boxes);
+    std::vector<std::vector<functor::CropAxisSample>> col_samples(num_boxes);
+    std::vector<int> first_slices(num_boxes);
+    // Not a vector<bool>, whose bits could not be set from several threads.
+    std::vector<char> slice_is_zero(static_cast<int64>(num_boxes) * num_slices);
+    auto prepare_boxes = [&](int64 start_box, int64 limit_box) {
+      for (int b = start_box; b < limit_box; ++b) {
+        const float* box = boxes_data + 6 * b;
+        ComputePlaneSamples(layout, box, crop_height, crop_width,
+                            &row_samples[b], &col_samples[b]);
+        first_slices[b] = FirstSlice(layout, box, num_slices);
+        for (int s = 0; s < num_slices; ++s) {
+          const int64 plane = static_cast<int64>(b) * num_slices + s;
+          slice_is_zero[plane] =
+              functor::AllZero(grads_data + plane * crop_plane, crop_plane);
+        }
+      }
+    };
+    auto worker_threads = context->device()->tensorflow_cpu_worker_threads();
+    Shard(worker_threads->num_threads, worker_threads->workers, num_boxes,
+          static_cast<int64>(num_slices) * crop_plane, prepare_boxes);
+
+    // Boxes of the same image may overlap, so the scatter is split over the
+    // slices of the output images instead: every slice is written by one
+    // thread only, from the slices of the boxes that fall on it. Even a
+    // single image of a single channel is then spread over its slices.
+    const int image_slices = layout.sizes[layout.slice_axis];
+    std::vector<std::vector<std::pair<int, int>>> box_slices_of_plane(
+        static_cast<int64>(batch_size) * image_slices);
+    for (int b = 0; b < num_boxes; ++b) {
+      for (int s = 0; s < num_slices; ++s) {
+        const int slice = first_slices[b] + s;
+        if (FastBoundsCheck(slice, image_slices) &&
+            !slice_is_zero[static_cast<int64>(b) * num_slices + s]) {
+          box_slices_of_plane[static_cast<int64>(box_indexT(b)) * image_slices +
+                              slice].emplace_back(b, s);
+        }
+      }
+    }
+    auto scatter_slices = [&](int64 start, int64 limit) {
+      for (int64 unit = start; unit < limit; ++unit) {
+        const int b_in = unit / image_slices;
+        const int slice = unit % image_slices;
+        float* image_slice =
+            grads_image + b_in * image_volume + slice * slice_stride;
+
+        for (const std::pair<int, int>& box_slice : box_slices_of_plane[unit]) {
+          const int b = box_slice.first;
+          const float* plane =
+              grads_data +
+              (static_cast<int64>(b) * num_slices + box_slice.second) *
+                  crop_plane;
+
+          for (int i = 0; i < crop_height; ++i) {
+            const functor::CropAxisSample& rs = row_samples[b][i];
+            if (!rs.valid) {
+              continue;
+            }
+            float* top = image_slice + rs.lower * row_stride;
+            float* bottom = image_slice + rs.upper * row_stride;
+            const float row_lerp = rs.lerp;
+
+            for (int j = 0; j < crop_width; ++j) {
+              const functor::CropAxisSample& cs = col_samples[b][j];
+              if (!cs.valid) {
+                continue;
+              }
+              const float* g = plane + (static_cast<int64>(i) * crop_width + j) * depth;
+              const float col_lerp = cs.lerp;
+              float* top_left = top + cs.lower * col_stride;
+              float* top_right = top + cs.upper * col_stride;
+              float* bottom_left = bottom + cs.lower * col_stride;
+              float* bottom_right = bottom + cs.upper * col_stride;
+              for (int d = 0; d < depth; ++d) {
+                const float dtop = (1 - row_lerp) * g[d];
+                const float dbottom = row_lerp * g[d];
+                top_left[d] += (1 - col_lerp) * dtop;
+                top_right[d] += col_lerp * dtop;
+                bottom_left[d] += (1 - col_lerp) * dbottom;
+                bottom_right[d] += col_lerp * dbottom;
+              }
+            }
+          }
+        }
+      }
+    };
+    const int64 num_planes = static_cast<int64>(batch_size) * image_slices;
+    const int64 cost_per_plane =
+        static_cast<int64>(num_boxes) * num_slices * crop_plane * 10 /
+        std::max<int64>(num_planes, 1);
+    Shard(worker_threads->num_threads, worker_threads->workers, num_planes,
+          std::max<int64>(cost_per_plane, 1), scatter_slices);
+  }
+private:
+  int axis_ ;
+};
+
+REGISTER_KERNEL_BUILDER(Name("SliceStackCropGradImage").Device(DEVICE_CPU), SliceStackCropGradImageOp);
@@ -0,0 +1,67 @@
+#include "tensorflow/core/framework/op.h"
+#include "tensorflow/core/framework/shape_inference.h"
+
+using namespace tensorflow;
+
+// The slices of a stack are taken along image axis 'axis' (0 for y, 1 for x,
+// 2 for z) and resized over the two other axes, kept in image order.
+
+REGISTER_OP("SliceStackCrop")
+    .Input("image: float")
+    .Input("boxes: float")
+    .Input("box_index: int32")
+    .Input("crop_size: int32")
+    .Output("crops: float")
+    .Attr("num_slices: int >= 1 = 3")
+    .Attr("axis: int = 2")
+    .Attr("extrapolation_value: float = 0")
+    .SetShapeFn([](::tensorflow::shape_inference::InferenceContext* c) {
+      // Get inputs and validate ranks.
+      ::tensorflow::shape_inference::ShapeHandle input;
+      TF_RETURN_IF_ERROR(c->WithRank(c->input(0), 5, &input));
+      ::tensorflow::shape_inference::ShapeHandle boxes;
+      TF_RETURN_IF_ERROR(c->WithRank(c->input(1), 2, &boxes));
+      ::tensorflow::shape_inference::ShapeHandle box_ind;
+      TF_RETURN_IF_ERROR(c->WithRank(c->input(2), 1, &box_ind));
+
+      // boxes[0] and box_ind[0] are both num_boxes.
+      ::tensorflow::shape_inference::DimensionHandle num_boxes_dim;
+      TF_RETURN_IF_ERROR(
+          c->Merge(c->Dim(boxes, 0), c->Dim(box_ind, 0), &num_boxes_dim));
+
+      // boxes.dim(1) is 6.
+      ::tensorflow::shape_inference::DimensionHandle unused;
+      TF_RETURN_IF_ERROR(c->WithValue(c->Dim(boxes, 1), 6, &unused));
+
+      // crop_size holds the two in-plane crop dimensions.
+      ::tensorflow::shape_inference::ShapeHandle crop_size;
+      TF_RETURN_IF_ERROR(c->WithRank(c->input(3), 1, &crop_size));
+      TF_RETURN_IF_ERROR(c->WithValue(c->Dim(crop_size, 0), 2, &unused));
+      ::tensorflow::shape_inference::ShapeHandle crop_shape;
+      TF_RETURN_IF_ERROR(c->MakeShapeFromShapeTensor(3, &crop_shape));
+
+      int num_slices;
+      TF_RETURN_IF_ERROR(c->GetAttr("num_slices", &num_slices));
+      ::tensorflow::shape_inference::ShapeHandle out =
+          c->MakeShape({num_boxes_dim, c->MakeDim(num_slices)});
+      TF_RETURN_IF_ERROR(c->Concatenate(out, crop_shape, &out));
+      TF_RETURN_IF_ERROR(
+          c->Concatenate(out, c->Vector(c->Dim(input, 4)), &out));
+      c->set_output(0, out);
+      return Status::OK();
+    });
+
+REGISTER_OP("SliceStackCropGradImage")
+    .Input("grads: float")
+    .Input("boxes: float")
+    .Input("box_index: int32")
+    .Input("image_size: int32")
+    .Output("output: float")
+    .Attr("axis: int = 2")
+    .SetShapeFn([](::tensorflow::shape_inference::InferenceContext* c) {
+      ::tensorflow::shape_inference::ShapeHandle out;
+      TF_RETURN_IF_ERROR(c->MakeShapeFromShapeTensor(3, &out));
+      TF_RETURN_IF_ERROR(c->WithRank(out, 5, &out));
+      c->set_output(0, out);
+      return Status::OK();
+    });
@@ -0,0 +1,37 @@
+from tensorflow.python.framework import dtypes
+from tensorflow.python.framework import load_library
+from tensorflow.python.framework import ops
+from tensorflow.python.ops import array_ops
+from tensorflow.python.platform import resource_loader
+
+
+slice_stack_crop_ops = load_library.load_op_library(
+    resource_loader.get_path_to_datafile('_slice_stack_crop_ops.so'))
+
+
+def slice_stack_crop(image, boxes, box_index, crop_size, num_slices=3, axis=2,
+                     extrapolation_value=0, name=None):
+    """Crops a stack of `num_slices` neighbouring slices out of every box.
+
+    The slices are taken at full resolution along image axis `axis` (0 for y,
+    1 for x, 2 for z), around the slice nearest to the center of the box, and
+    each of them is resized bilinearly to the two-element `crop_size` over the
+    two other axes. Boxes follow the crop_and_resize_3d conventions. Returns a
+    tensor of shape [num_boxes, num_slices, *crop_size, channels]; slices
+    outside of the image are filled with `extrapolation_value`.
+    """
+    return slice_stack_crop_ops.slice_stack_crop(
+        image, boxes, box_index, crop_size, num_slices=num_slices, axis=axis,
+        extrapolation_value=extrapolation_value, name=name)
+
+
+slice_stack_crop_grad_image = slice_stack_crop_ops.slice_stack_crop_grad_image
+
+
+@ops.RegisterGradient("SliceStackCrop")
+def _slice_stack_crop_grad(op, grad):
+    image_size = array_ops.shape(op.inputs[0], out_type=dtypes.int32)
+    grad_image = slice_stack_crop_grad_image(grad, op.inputs[1], op.inputs[2],
+                                             image_size,
+                                             axis=op.get_attr('axis'))
+    return [grad_image, None, None, None]
@@ -0,0 +1,154 @@
+import os
+import numpy as np
+import tensorflow as tf
+
+from crop_and_resize_3d import crop_and_resize_3d
+from slice_stack_crop import slice_stack_crop
+
+# Comment the following line to debug TF or libcuda issues
+os.environ['TF_CPP_MIN_LOG_LEVEL'] = '3'
+
+np.random.seed(0)
+image = np.random.rand(2, 9, 10, 11, 3).astype(np.float32)
+corners = np.random.rand(4, 2, 3)
+boxes = np.concatenate([corners.min(1), corners.max(1)], 1).astype(np.float32)
+box_index = np.array([0, 1, 1, 0], np.int32)
+crop_size = [5, 6]
+num_slices = 3
+
+
+def slice_stack_from_crop(image, boxes, box_index, crop_size, num_slices, axis):
+    # Every slice is a crop_and_resize_3d crop of a single voxel along axis.
+    image_size = np.shape(image)[axis + 1]
+    stacks = []
+    for i in range(np.shape(boxes)[0]):
+        center = int(np.round(0.5 * (boxes[i, axis] + boxes[i, axis + 3]) * (image_size - 1)))
+        slices = []
+        for s in range(center - (num_slices - 1) // 2, center - (num_slices - 1) // 2 + num_slices):
+            box = boxes[i].copy()
+            box[axis] = box[axis + 3] = s / (image_size - 1)
+            size = list(crop_size)
+            size.insert(axis, 1)
+            crop = crop_and_resize_3d(tf.constant(image, tf.float32), tf.constant(box[None], tf.float32),
+                                      tf.constant(box_index[i:i + 1], tf.int32), tf.constant(size, tf.int32),
+                                      extrapolation_value=-1)
+            slices.append(np.squeeze(crop.numpy()[0], axis))
+        stacks.append(np.stack(slices))
+    return np.stack(stacks)
+
+
+def crop_axis_samples(start, end, image_size, crop_size):
+    # The (valid, lower, upper, lerp) sampling table of CropAndResize3D.
+    samples = []
+    for i in range(crop_size):
+        if crop_size > 1:
+            x = start * (image_size - 1) + i * (end - start) * (image_size - 1) / (crop_size - 1)
+        else:
+            x = 0.5 * (start + end) * (image_size - 1)
+        lower = int(np.floor(x))
+        samples.append((0 <= x <= image_size - 1, lower, int(np.ceil(x)), x - lower))
+    return samples
+
+
+def slice_stack_grad_from_loops(grads, boxes, box_index, image_shape, axis):
+    # Dense reference: every gradient voxel is scattered with its four
+    # bilinear weights, box by box.
+    output = np.zeros(image_shape, np.float64)
+    num_slices = grads.shape[1]
+    row_axis = 1 if axis == 0 else 0
+    col_axis = 1 if axis == 2 else 2
+    sizes = image_shape[1:4]
+    for b in range(np.shape(boxes)[0]):
+        image_b = np.moveaxis(output[box_index[b]], (axis, row_axis, col_axis), (0, 1, 2))
+        center = int(np.round(0.5 * (boxes[b, axis] + boxes[b, axis + 3]) * (sizes[axis] - 1)))
+        rows = crop_axis_samples(boxes[b, row_axis], boxes[b, row_axis + 3], sizes[row_axis], grads.shape[2])
+        cols = crop_axis_samples(boxes[b, col_axis], boxes[b, col_axis + 3], sizes[col_axis], grads.shape[3])
+        for s in range(num_slices):
+            slice_ = center - (num_slices - 1) // 2 + s
+            if not 0 <= slice_ < sizes[axis]:
+                continue
+            for i, (row_valid, top, bottom, row_lerp) in enumerate(rows):
+                for j, (col_valid, left, right, col_lerp) in enumerate(cols):
+                    if not (row_valid and col_valid):
+                        continue
+                    g = grads[b, s, i, j].astype(np.float64)
+                    image_b[slice_, top, left] += (1 - row_lerp) * (1 - col_lerp) * g
+                    image_b[slice_, top, right] += (1 - row_lerp) * col_lerp * g
+                    image_b[slice_, bottom, left] += row_lerp * (1 - col_lerp) * g
+                    image_b[slice_, bottom, right] += row_lerp * col_lerp * g
+    return output
+
+
+#TestSliceStackCrop
+for axis in range(3):
+    results = slice_stack_crop(tf.constant(image, tf.float32), tf.constant(boxes, tf.float32),
+                               tf.constant(box_index, tf.int32), tf.constant(crop_size, tf.int32),
+                               num_slices=num_slices, axis=axis, extrapolation_value=-1)
+    control = slice_stack_from_crop(image, boxes, box_index, crop_size, num_slices, axis)
+    if results.shape == control.shape and np.allclose(results.numpy(), control, atol=1e-4):
+        print('TestSliceStackCrop (axis %d) is OK.' % axis)
+    else:
+        print('TestSliceStackCrop (axis %d) is not OK.' % axis)
+
+#TestSliceStackCropOutsideSlices
+edge_boxes = np.array([[0.1, 0.1, 0, 0.9, 0.9, 0]], np.float32)
+results = slice_stack_crop(tf.constant(image, tf.float32), tf.constant(edge_boxes, tf.float32),
+                           tf.constant([0], tf.int32), tf.constant(crop_size, tf.int32),
+                           num_slices=4, extrapolation_value=-1)
+# Slices -1, 0, 1 and 2: only the first one lies outside of the image.
+if (results.numpy()[0, 0] == -1).all() and (results.numpy()[0, 1:] >= 0).all():
+    print('TestSliceStackCropOutsideSlices is OK.')
+else:
+    print('TestSliceStackCropOutsideSlices is not OK.')
+
+#TestSliceStackCropGradient
+# The op is linear in the image, so <crop(image), g> == <image, grad(g)>.
+for axis in range(3):
+    image_t = tf.constant(image, tf.float32)
+    grads = np.random.rand(4, num_slices, *crop_size, 3).astype(np.float32)
+    with tf.GradientTape() as tape:
+        tape.watch(image_t)
+        results = slice_stack_crop(image_t, tf.constant(boxes, tf.float32),
+                                   tf.constant(box_index, tf.int32), tf.constant(crop_size, tf.int32),
+                                   num_slices=num_slices, axis=axis)
+        loss = tf.reduce_sum(results * grads)
+    grad = tape.gradient(loss, image_t)
+    if np.isclose(loss.numpy(), np.sum(image * grad.numpy()), rtol=1e-4):
+        print('TestSliceStackCropGradient (axis %d) is OK.' % axis)
+    else:
+        print('TestSliceStackCropGradient (axis %d) is not OK.' % axis)
+
+#TestSliceStackCropGradientSingleImageChannel
+# One image of one channel and many overlapping boxes, the usual 2.5D case,
+# against the dense scatter of the gradient.
+single_image = np.random.rand(1, 12, 13, 14, 1).astype(np.float32)
+corners = 0.3 + 0.4 * np.random.rand(8, 2, 3)
+single_boxes = np.concatenate([corners.min(1), corners.max(1)], 1).astype(np.float32)
+single_box_index = np.zeros(8, np.int32)
+for axis in range(3):
+    image_t = tf.constant(single_image, tf.float32)
+    grads = np.random.rand(8, num_slices, *crop_size, 1).astype(np.float32)
+    with tf.GradientTape() as tape:
+        tape.watch(image_t)
+        results = slice_stack_crop(image_t, tf.constant(single_boxes, tf.float32),
+                                   tf.constant(single_box_index, tf.int32), tf.constant(crop_size, tf.int32),
+                                   num_slices=num_slices, axis=axis)
+        loss = tf.reduce_sum(results * grads)
+    grad = tape.gradient(loss, image_t)
+    control = slice_stack_grad_from_loops(grads, single_boxes, single_box_index, single_image.shape, axis)
+    if np.allclose(grad.numpy(), control, atol=1e-4):
+        print('TestSliceStackCropGradientSingleImageChannel (axis %d) is OK.' % axis)
+    else:
+        print('TestSliceStackCropGradientSingleImageChannel (axis %d) is not OK.' % axis)
+
+#TestInvalidAxis
+try:
+    results = slice_stack_crop(tf.constant(image, tf.float32), tf.constant(boxes, tf.float32),
+                               tf.constant(box_index, tf.int32), tf.constant(crop_size, tf.int32),
+                               axis=3)
+    print('TestInvalidAxis is not OK.')
+except Exception as e:
+    if 'axis must be 0, 1 or 2' in str(e):
+        print('TestInvalidAxis is OK.')
+    else:
+        print('TestInvalidAxis is not OK.')
\ No newline at end of file